@@ -0,0 +1,55 @@
+// this class's header
+#include "EventArena.h"
+
+// stl includes
+#include <algorithm>
+
+EventArena::EventArena(size_t block_size):
+  m_block_size(block_size),
+  m_current(0),
+  m_offset(0),
+  m_event_bytes(0)
+{
+}
+
+void* EventArena::allocate(size_t bytes, size_t alignment) {
+  m_counters.allocations++;
+  m_counters.bytes += bytes;
+  m_event_bytes += bytes;
+
+  // Look for space in the blocks we already have. Once we move on to
+  // the next block, the end of the last one is wasted until the next
+  // reset.
+  while (m_current < m_blocks.size()) {
+    Block& block = m_blocks.at(m_current);
+    size_t start = (m_offset + alignment - 1) / alignment * alignment;
+    if (start + bytes <= block.size) {
+      m_offset = start + bytes;
+      return block.data.get() + start;
+    }
+    m_current++;
+    m_offset = 0;
+  }
+
+  // If we get here we need another block. Requests which are bigger
+  // than the usual block size get a block of their own. Note that
+  // `new char[]` is aligned for any fundamental type.
+  size_t size = std::max(m_block_size, bytes);
+  m_blocks.push_back({std::unique_ptr<char[]>(new char[size]), size});
+  m_counters.heap_blocks++;
+  m_current = m_blocks.size() - 1;
+  m_offset = bytes;
+  return m_blocks.back().data.get();
+}
+
+void EventArena::reset() {
+  m_counters.resets++;
+  m_counters.peak_bytes = std::max(m_counters.peak_bytes, m_event_bytes);
+  m_event_bytes = 0;
+  m_current = 0;
+  m_offset = 0;
+}
+
+const EventArena::Counters& EventArena::counters() const {
+  return m_counters;
+}
@@ -0,0 +1,94 @@
+#ifndef EVENT_ARENA_H
+#define EVENT_ARENA_H
+
+//////////////////////////////////////////////////////////////////////
+// EventArena class
+//////////////////////////////////////////////////////////////////////
+//
+// A very simple "monotonic" allocator for things that only live for
+// one event. Allocations just bump a pointer in a big block of
+// memory, and nothing is freed until `reset()` is called at the end
+// of the event. The blocks are kept around for the next event, so
+// after the first few events we stop calling malloc entirely.
+//
+// Use it with standard containers through ArenaAllocator, i.e.
+//
+//   std::vector<int, ArenaAllocator<int> > v(arena);
+//
+// Anything allocated from the arena is invalid after `reset()`.
+//
+//////////////////////////////////////////////////////////////////////
+
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+class EventArena
+{
+public:
+  explicit EventArena(size_t block_size = 1 << 16);
+
+  // Copying an arena would mean copying everything allocated from
+  // it, so we don't allow it.
+  EventArena(EventArena&) = delete;
+  EventArena operator=(EventArena&) = delete;
+
+  void* allocate(size_t bytes, size_t alignment);
+  void reset();
+
+  // some counters to see how much we're using the arena
+  struct Counters
+  {
+    size_t allocations = 0;     // total calls to allocate
+    size_t bytes = 0;           // total bytes handed out
+    size_t heap_blocks = 0;     // blocks we had to get from the heap
+    size_t peak_bytes = 0;      // most bytes used in one event
+    size_t resets = 0;          // number of events
+  };
+  const Counters& counters() const;
+
+private:
+  struct Block
+  {
+    std::unique_ptr<char[]> data;
+    size_t size;
+  };
+  std::vector<Block> m_blocks;
+  size_t m_block_size;
+  size_t m_current;             // index of the block we're filling
+  size_t m_offset;              // offset within that block
+  size_t m_event_bytes;         // bytes used in this event
+  Counters m_counters;
+};
+
+// Allocator that draws from an EventArena. Deallocation does
+// nothing, the memory comes back when the arena is reset.
+template <typename T>
+class ArenaAllocator
+{
+public:
+  typedef T value_type;
+  ArenaAllocator(EventArena& arena): m_arena(&arena) {}
+  template <typename U>
+  ArenaAllocator(const ArenaAllocator<U>& other): m_arena(other.arena()) {}
+
+  T* allocate(size_t n) {
+    return static_cast<T*>(m_arena->allocate(n * sizeof(T), alignof(T)));
+  }
+  void deallocate(T*, size_t) {}
+  EventArena* arena() const { return m_arena; }
+
+private:
+  EventArena* m_arena;
+};
+
+template <typename T, typename U>
+bool operator==(const ArenaAllocator<T>& a, const ArenaAllocator<U>& b) {
+  return a.arena() == b.arena();
+}
+template <typename T, typename U>
+bool operator!=(const ArenaAllocator<T>& a, const ArenaAllocator<U>& b) {
+  return a.arena() != b.arena();
+}
+
+#endif
@@ -0,0 +1,38 @@
+#ifndef JET_ROW_H
+#define JET_ROW_H
+
+//////////////////////////////////////////////////////////////////////
+// JetRow struct
+//////////////////////////////////////////////////////////////////////
+//
+// The kinematic jet variables we save in `dump-events`, as a plain
+// struct that can be written with the StructWriter.
+//
+//////////////////////////////////////////////////////////////////////
+
+#include "StructWriter.h"
+
+struct JetRow
+{
+  float pt;
+  float eta;
+  float phi;
+  float m;
+  float btag;
+};
+
+namespace H5Struct {
+  template <> struct RowLayout<JetRow> {
+    static std::vector<RowField> fields() {
+      return {
+        field("pt", &JetRow::pt),
+        field("eta", &JetRow::eta),
+        field("phi", &JetRow::phi),
+        field("m", &JetRow::m),
+        field("btag", &JetRow::btag)
+      };
+    }
+  };
+}
+
+#endif
@@ -0,0 +1,208 @@
+#ifndef STRUCT_WRITER_H
+#define STRUCT_WRITER_H
+
+//////////////////////////////////////////////////////////////////////
+// StructWriter class
+//////////////////////////////////////////////////////////////////////
+//
+// The H5Utils::Writer is very flexible: you give it a list of
+// functions and it calls each one to get a value for each field. But
+// if you already have your data in a plain struct that's a lot of
+// overhead: every field of every row goes through a type-erased
+// function call.
+//
+// This writer takes the struct itself. You describe the fields once
+// by specializing RowLayout, i.e.
+//
+//   struct Event { unsigned int firstJet; unsigned int nJets; };
+//   namespace H5Struct {
+//     template<> struct RowLayout<Event> {
+//       static std::vector<RowField> fields() {
+//         return { field("firstJet", &Event::firstJet),
+//                  field("nJets", &Event::nJets) };
+//       }
+//     };
+//   }
+//
+// and the HDF5 compound type is built from that. Rows are copied
+// into the buffer as raw bytes, and HDF5 takes the whole buffer at
+// once.
+//
+// If the dataset already exists (i.e. the output file was opened to
+// append) the new rows are added to the end, as long as the types
+// and compression match. In that case `index()` counts the rows
+// that were already there. The dataset is marked as appendable (see
+// Appendable.h), so rows from a job that didn't finish are removed
+// the next time we append.
+//
+//////////////////////////////////////////////////////////////////////
+
+// shared things
+#include "Root/Appendable.h"
+
+// HDF5 things
+#include "H5Cpp.h"
+
+// stl things
+#include <cstring>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+// The helpers to describe a struct live in their own namespace, to
+// keep short names like `field` out of the global one.
+namespace H5Struct {
+
+  // Map C++ types to HDF5 types. Add more here if you need them.
+  template <typename T> struct H5Type;
+  template <> struct H5Type<float> {
+    static const H5::PredType& get() { return H5::PredType::NATIVE_FLOAT; }
+  };
+  template <> struct H5Type<double> {
+    static const H5::PredType& get() { return H5::PredType::NATIVE_DOUBLE; }
+  };
+  template <> struct H5Type<int> {
+    static const H5::PredType& get() { return H5::PredType::NATIVE_INT; }
+  };
+  template <> struct H5Type<unsigned int> {
+    static const H5::PredType& get() { return H5::PredType::NATIVE_UINT; }
+  };
+  template <> struct H5Type<long long> {
+    static const H5::PredType& get() { return H5::PredType::NATIVE_LLONG; }
+  };
+
+  // Description of one field in a struct
+  struct RowField
+  {
+    std::string name;
+    size_t offset;
+    const H5::PredType& type;
+  };
+
+  // Build a RowField from a pointer to a member. The type and offset
+  // come from the member pointer, so they can't get out of sync with
+  // the struct.
+  template <typename T, typename M>
+  RowField field(const std::string& name, M T::*member) {
+    static_assert(std::is_standard_layout<T>::value,
+                  "rows must be standard layout structs");
+    T row{};
+    const char* base = reinterpret_cast<const char*>(&row);
+    const char* pos = reinterpret_cast<const char*>(&(row.*member));
+    return {name, size_t(pos - base), H5Type<M>::get()};
+  }
+
+  // Specialize this for each struct you want to write
+  template <typename T> struct RowLayout;
+
+}
+
+
+template <typename T>
+class StructWriter
+{
+public:
+  static_assert(std::is_trivially_copyable<T>::value,
+                "rows have to be copied with memcpy");
+
+  // `deflate` is the compression level, zero turns it off
+  StructWriter(H5::Group& group, const std::string& name,
+               hsize_t batch_size = 2048, int deflate = 7);
+  ~StructWriter();
+
+  StructWriter(StructWriter&) = delete;
+  StructWriter operator=(StructWriter&) = delete;
+
+  // add one row, or an array of rows
+  void fill(const T& row);
+  void fill(const T* rows, size_t n_rows);
+  void flush();
+
+  // number of rows that have been filled so far
+  hsize_t index() const;
+
+private:
+  H5::CompType m_type;
+  H5::DataSet m_dataset;
+  hsize_t m_batch_size;
+  hsize_t m_n_written;
+  std::vector<T> m_buffer;
+};
+
+template <typename T>
+StructWriter<T>::StructWriter(H5::Group& group, const std::string& name,
+                              hsize_t batch_size, int deflate):
+  m_type(sizeof(T)),
+  m_batch_size(batch_size),
+  m_n_written(0)
+{
+  for (const H5Struct::RowField& f: H5Struct::RowLayout<T>::fields()) {
+    m_type.insertMember(f.name, f.offset, f.type);
+  }
+
+  // In the file we don't want any padding. Note that we need a real
+  // copy here: copying the CompType object would only copy the id.
+  H5::CompType file_type;
+  file_type.copy(m_type);
+  file_type.pack();
+
+  // Same layout as the H5Utils::Writer uses: 1d, extensible,
+  // chunked, and (unless asked not to) compressed.
+  hsize_t dims[1] = {0};
+  hsize_t max_dims[1] = {H5S_UNLIMITED};
+  H5::DataSpace space(1, dims, max_dims);
+  H5::DSetCreatPropList props;
+  hsize_t chunks[1] = {m_batch_size};
+  props.setChunk(1, chunks);
+  if (deflate > 0) props.setDeflate(deflate);
+  if (exists(group, name)) {
+    m_dataset = group.openDataSet(name);
+    checkAppendable(m_dataset, file_type, props, {});
+    m_dataset.getSpace().getSimpleExtentDims(&m_n_written);
+  } else {
+    m_dataset = group.createDataSet(name, file_type, space, props);
+  }
+  markAppendable(m_dataset);
+  m_buffer.reserve(m_batch_size);
+}
+
+template <typename T>
+StructWriter<T>::~StructWriter() {
+  flush();
+}
+
+template <typename T>
+void StructWriter<T>::fill(const T& row) {
+  fill(&row, 1);
+}
+
+template <typename T>
+void StructWriter<T>::fill(const T* rows, size_t n_rows) {
+  size_t old_size = m_buffer.size();
+  m_buffer.resize(old_size + n_rows);
+  std::memcpy(m_buffer.data() + old_size, rows, n_rows * sizeof(T));
+  if (m_buffer.size() >= m_batch_size) flush();
+}
+
+template <typename T>
+void StructWriter<T>::flush() {
+  if (m_buffer.empty()) return;
+  hsize_t n_rows = m_buffer.size();
+  hsize_t new_size[1] = {m_n_written + n_rows};
+  m_dataset.extend(new_size);
+  H5::DataSpace file_space = m_dataset.getSpace();
+  hsize_t start[1] = {m_n_written};
+  hsize_t count[1] = {n_rows};
+  file_space.selectHyperslab(H5S_SELECT_SET, count, start);
+  H5::DataSpace mem_space(1, count);
+  m_dataset.write(m_buffer.data(), m_type, mem_space, file_space);
+  m_n_written += n_rows;
+  m_buffer.clear();
+}
+
+template <typename T>
+hsize_t StructWriter<T>::index() const {
+  return m_n_written + m_buffer.size();
+}
+
+#endif
@@ -8,6 +8,12 @@
 // ATLAS things
 #include "xAODJet/Jet.h"
 
+// ROOT things
+#include "TVector2.h"
+
+// stl things
+#include <cmath>
+
 //////////////////////////////////////////////////////////////////////
 // Class constructor
 //////////////////////////////////////////////////////////////////////
@@ -16,9 +22,10 @@
 // responsible for copying variables out of EDM objects and into the
 // output file.
 //
-TrackWriter::TrackWriter(H5::Group& output_group):
+TrackWriter::TrackWriter(H5::Group& output_group, EventArena& arena):
   m_ghost_accessor("GhostTrack"),
-  m_writer(nullptr)
+  m_writer(nullptr),
+  m_arena(arena)
 {
   // we operate on pairs of Jets and Tracks. Note that we need to
   // provide a default value here since some of the outputs might end
@@ -31,10 +38,15 @@ TrackWriter::TrackWriter(H5::Group& output_group):
   fillers.add<float>(
     "eta",[](const JetTrack& jt) {return jt.track->pt();}, NAN);
 
-  // also save the deltaR with respect to the jet
+  // also save the deltaR with respect to the jet. We could get this
+  // from `p4()`, but that builds two TLorentzVectors for every track,
+  // and all we need is eta and phi.
   fillers.add<float>(
     "deltaR", [](const JetTrack& jt) {
-                return jt.track->p4().DeltaR(jt.jet->p4());
+                double deta = jt.track->eta() - jt.jet->eta();
+                double dphi = TVector2::Phi_mpi_pi(
+                  jt.track->phi() - jt.jet->phi());
+                return std::hypot(deta, dphi);
               }, NAN);
 
   // Now we define the writer. Note that the last argument gives the
@@ -63,7 +75,9 @@ void TrackWriter::write(const xAOD::Jet& jet) {
   // We're going to do a bit of processing on the tracks before
   // writing them out.
   //
-  std::vector<JetTrack> pairs;
+  // This vector only lives until the end of the function, so we take
+  // the memory from the event arena rather than the heap.
+  std::vector<JetTrack, ArenaAllocator<JetTrack> > pairs(m_arena);
   // Grab the ghost links and loop over them
   for (const auto& link: m_ghost_accessor(jet)) {
 
@@ -101,3 +115,7 @@ void TrackWriter::write(const xAOD::Jet& jet) {
 
   m_writer->fill(pairs);
 }
+
+void TrackWriter::flush() {
+  m_writer->flush();
+}
@@ -16,13 +16,18 @@
 #include "xAODJet/JetContainer.h"
 #include "HDF5Utils/Writer.h"
 
+// local includes
+#include "EventArena.h"
+
 #include <memory>
 
 class TrackWriter
 {
 public:
-  // constructor: the writer will create the output dataset in some group
-  TrackWriter(H5::Group& output_group);
+  // constructor: the writer will create the output dataset in some
+  // group. Temporary objects are allocated from the arena, which the
+  // caller should reset after each event.
+  TrackWriter(H5::Group& output_group, EventArena& arena);
 
   // we want to disable copying and assignment, it's not trivial to
   // make this play well with output files
@@ -33,6 +38,9 @@ public:
   // write them.
   void write(const xAOD::Jet& jet);
 
+  // write out anything that's still buffered
+  void flush();
+
 private:
 
   // We want to have pairs of (jet, track) so that we can save
@@ -61,6 +69,9 @@ private:
 
   // The writer itself
   std::unique_ptr<JTWriter> m_writer;
+
+  // memory for temporary things
+  EventArena& m_arena;
 };
 
 #endif
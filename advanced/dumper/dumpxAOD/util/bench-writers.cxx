@@ -0,0 +1,139 @@
+// Benchmark for the two ways to write structs
+//
+// This compares the H5Utils::Writer, which calls one function for
+// each field, with the StructWriter, which copies whole structs. It
+// doesn't read any xAODs: the jets are made up.
+//
+// Both writers are given one jet per call. There are three
+// comparisons:
+//
+//  - In memory: calling one function per field to fill a buffer,
+//    which is what the H5Utils::Writer does for each row, vs copying
+//    the whole struct. Nothing is written, so this is only the cost
+//    of getting the values out.
+//
+//  - Written with compression: the H5Utils::Writer always compresses
+//    (at deflate level 7), so this is the only fair way to compare
+//    the two writers. The compression will probably take most of the
+//    time.
+//
+//  - Written without compression: this one is only possible for the
+//    StructWriter, but it shows how much of the time above was spent
+//    compressing.
+
+// local tools
+#include "Root/StructWriter.h"
+#include "Root/JetRow.h"
+
+// HDF5 things
+#include "HDF5Utils/Writer.h"
+#include "H5Cpp.h"
+
+// stl includes
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <functional>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+void usage(const char* name) {
+  std::cout << "usage: " << name << " [N_JETS]" << std::endl;
+}
+
+typedef std::chrono::steady_clock Clock;
+
+// time a function, in seconds
+template <typename F>
+double time_it(F func) {
+  auto start = Clock::now();
+  func();
+  return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+//////////////////
+// main routine //
+//////////////////
+int main (int argc, char *argv[])
+{
+  if (argc > 2) {
+    usage(argv[0]);
+    return 1;
+  }
+  const size_t n_jets = argc == 2 ? std::stoul(argv[1]) : 10000000;
+
+  // make up some jets
+  std::mt19937 random(42);
+  std::normal_distribution<float> gaus(0, 1);
+  std::vector<JetRow> jets;
+  for (size_t n = 0; n < n_jets; n++) {
+    jets.push_back({50e3f * (1 + std::abs(gaus(random))), gaus(random),
+          gaus(random), 5e3f * std::abs(gaus(random)), gaus(random)});
+  }
+
+  // These are the functions we give the consumers. Like the
+  // consumers, we store them as std::function.
+  typedef std::function<float(const JetRow&)> Getter;
+  std::vector<std::pair<std::string, Getter> > getters {
+    {"pt"  , [](const JetRow& j) { return j.pt;  }},
+    {"eta" , [](const JetRow& j) { return j.eta; }},
+    {"phi" , [](const JetRow& j) { return j.phi; }},
+    {"m"   , [](const JetRow& j) { return j.m; }},
+    {"btag", [](const JetRow& j) { return j.btag; }}};
+
+  // First, in memory. We fill a buffer of one batch (2048 rows) over
+  // and over, so that it stays in the cache.
+  const size_t batch = 2048;
+  std::vector<float> buffer(batch * getters.size());
+  double dispatch_time = time_it([&]() {
+      for (size_t n = 0; n < n_jets; n++) {
+        float* row = buffer.data() + (n % batch) * getters.size();
+        for (const auto& getter: getters) *row++ = getter.second(jets[n]);
+      }
+    });
+  float check = buffer.at(0);
+  double memcpy_time = time_it([&]() {
+      for (size_t n = 0; n < n_jets; n++) {
+        std::memcpy(buffer.data() + (n % batch) * getters.size(),
+                    &jets[n], sizeof(JetRow));
+      }
+    });
+  // make sure the compiler can't skip the loops above
+  check += buffer.at(0);
+
+  // Now write them out. We put each writer in its own scope so that
+  // the time to flush it at the end is included.
+  H5::H5File output("bench.h5", H5F_ACC_TRUNC);
+  double consumer_time = time_it([&]() {
+      H5Utils::Consumers<const JetRow&> jcon;
+      for (const auto& getter: getters) {
+        jcon.add<float>(getter.first, getter.second);
+      }
+      H5Utils::Writer<0, const JetRow&> writer(output, "consumers", jcon);
+      for (const JetRow& jet: jets) writer.fill(jet);
+    });
+  double struct_time = time_it([&]() {
+      StructWriter<JetRow> writer(output, "structs");
+      for (const JetRow& jet: jets) writer.fill(jet);
+    });
+  double uncompressed_time = time_it([&]() {
+      StructWriter<JetRow> writer(output, "structs_uncompressed", 2048, 0);
+      for (const JetRow& jet: jets) writer.fill(jet);
+    });
+
+  std::cout << "wrote " << n_jets << " jets (check: " << check << ")\n"
+            << "in memory, one function per field: " << dispatch_time
+            << " s\n"
+            << "in memory, memcpy:                 " << memcpy_time
+            << " s\n"
+            << "compressed, consumers:             " << consumer_time
+            << " s\n"
+            << "compressed, structs:               " << struct_time
+            << " s\n"
+            << "uncompressed, structs:             " << uncompressed_time
+            << " s" << std::endl;
+
+  return 0;
+}
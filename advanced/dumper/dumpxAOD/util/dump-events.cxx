@@ -1,3 +1,9 @@
+// local tools
+#include "Root/FilePrefetcher.h"
+#include "Root/OutputFile.h"
+#include "Root/StructWriter.h"
+#include "Root/JetRow.h"
+
 // EDM things
 #include "xAODJet/JetContainer.h"
 
@@ -5,10 +11,10 @@
 #include "xAODRootAccess/Init.h"
 #include "xAODRootAccess/TEvent.h"
 #include "xAODRootAccess/tools/ReturnCheck.h"
-#include "HDF5Utils/Writer.h"
 
 // 3rd party includes
 #include "TFile.h"
+#include "TROOT.h"
 #include "H5Cpp.h"
 
 // stl includes
@@ -24,6 +30,9 @@
 struct Options
 {
   std::vector<std::string> files;
+  bool prefetch = true;
+  std::string output_file = "output.h5";
+  bool append = false;
 };
 // simple options parser
 Options get_options(int argc, char *argv[]);
@@ -38,6 +47,18 @@ struct Event
   index_t firstJet;
   index_t nJets;
 };
+// This tells the StructWriter how to save an Event. The jets are
+// saved as JetRow, which is defined in Root/JetRow.h.
+namespace H5Struct {
+  template <> struct RowLayout<Event> {
+    static std::vector<RowField> fields() {
+      return {
+        field("firstJet", &Event::firstJet),
+        field("nJets", &Event::nJets)
+      };
+    }
+  };
+}
 
 //////////////////
 // main routine //
@@ -47,45 +68,53 @@ int main (int argc, char *argv[])
   const char* ALG = argv[0];
   Options opts = get_options(argc, argv);
 
+  // The input files are opened on a background thread, so ROOT needs
+  // to know we're using threads before we do anything else with it.
+  if (opts.prefetch) ROOT::EnableThreadSafety();
+
   // set up xAOD basics
   RETURN_CHECK(ALG, xAOD::Init());
   xAOD::TEvent event(xAOD::TEvent::kClassAccess);
 
-  // set up output file
-  H5::H5File output("output.h5", H5F_ACC_TRUNC);
-
-  // add event consumers
-  H5Utils::Consumers<const Event&> econ;
-  econ.add<index_t>("firstJet", [](const Event& e) { return e.firstJet; });
-  econ.add<index_t>("nJets", [](const Event& e) { return e.nJets; });
-  H5Utils::Writer<0, const Event&> ewriter(output, "event", econ);
+  // Set up output file. If we're appending to an existing file we
+  // skip any inputs that are already in it. Anything that was written
+  // by a job that didn't finish is removed when the file is opened.
+  std::vector<std::string> files = uniqueInputs(opts.files);
+  H5::H5File output = openOutput(opts.output_file, opts.append);
+  if (opts.append) {
+    size_t n_inputs = files.size();
+    files = removeProcessed(files, readProvenance(output));
+    std::cout << "skipping " << n_inputs - files.size()
+              << " files that are already in the output" << std::endl;
+  }
 
-  // add jet consumers
-  using xAOD::Jet;
-  H5Utils::Consumers<const Jet&> jcon;
-  jcon.add<float>("pt"  , [](const Jet& j) { return j.pt();  });
-  jcon.add<float>("eta" , [](const Jet& j) { return j.eta(); });
-  jcon.add<float>("phi" , [](const Jet& j) { return j.phi(); });
-  jcon.add<float>("m"   , [](const Jet& j) { return j.m(); });
+  // Both the events and the jets are plain structs, so rather than
+  // going through H5Utils::Consumers we use the StructWriter, which
+  // copies whole structs into the output buffer.
+  //
+  // When we append to an existing file these pick up where the last
+  // job left off, so `firstJet` still points to the right place.
+  StructWriter<Event> ewriter(output, "event");
+  StructWriter<JetRow> jwriter(output, "jet");
 
-  // let's also add some b-tagging info
+  // we'll also add some b-tagging info
   typedef SG::AuxElement AE;
   AE::ConstAccessor<double> pb("DL1_pb");
   AE::ConstAccessor<double> pc("DL1_pc");
   AE::ConstAccessor<double> pu("DL1_pu");
-  jcon.add<float>("btag", [pb, pc, pu](const Jet& j) {
-                            const xAOD::BTagging* bp = j.btagging();
-                            if (!bp) throw std::runtime_error("missing b");
-                            const xAOD::BTagging& b = *bp;
-                            return pb(b) / (pc(b)*0.1 + pu(b)*0.9);
-                          });
-  H5Utils::Writer<0, const Jet&> jwriter(output, "jet", jcon);
+
+  // the jets in each event are collected here before they are written
+  std::vector<JetRow> jet_rows;
+
+  // The next file is opened in the background while we process the
+  // current one.
+  FilePrefetcher prefetcher(files, opts.prefetch);
 
   // Loop over the specified files:
-  for (std::string file_name: opts.files) {
+  for (std::string file_name: files) {
 
     // Open the file:
-    std::unique_ptr<TFile> ifile(TFile::Open(file_name.c_str(), "READ"));
+    std::unique_ptr<TFile> ifile = prefetcher.open(file_name);
     if ( ! ifile.get() || ifile->IsZombie()) {
       throw std::logic_error("Couldn't open file: " + file_name);
     }
@@ -111,17 +140,35 @@ int main (int argc, char *argv[])
       const xAOD::JetContainer *jets = 0;
       RETURN_CHECK(ALG, event.retrieve(jets, "AntiKt4EMTopoJets"));
 
-      Event event;
-      event.firstJet = jwriter.index();
+      jet_rows.clear();
       for (const xAOD::Jet *jet : *jets) {
-        jwriter.fill(*jet);
+        const xAOD::BTagging* bp = jet->btagging();
+        if (!bp) throw std::runtime_error("missing b");
+        const xAOD::BTagging& b = *bp;
+        JetRow row;
+        row.pt = jet->pt();
+        row.eta = jet->eta();
+        row.phi = jet->phi();
+        row.m = jet->m();
+        row.btag = pb(b) / (pc(b)*0.1 + pu(b)*0.9);
+        jet_rows.push_back(row);
       }
-      event.nJets = jwriter.index() - event.firstJet;
+
+      Event event;
+      event.firstJet = jwriter.index();
+      event.nJets = jet_rows.size();
+      jwriter.fill(jet_rows.data(), jet_rows.size());
       ewriter.fill(event);
 
     } // end event loop
   } // end file loop
 
+  prefetcher.printSummary(std::cout);
+
+  // write out everything, then record the files we've added
+  jwriter.flush();
+  ewriter.flush();
+  commitOutput(output, files);
 
   return 0;
 }
@@ -129,14 +176,22 @@ int main (int argc, char *argv[])
 
 // define the options parser
 void usage(std::string name) {
-  std::cout << "usage: " << name << " [-h] <AOD>..." << std::endl;
+  std::cout << "usage: " << name << " [-h] [--no-prefetch]"
+    " [-o OUTPUT] [--append] <AOD>..." << std::endl;
 }
 
 Options get_options(int argc, char *argv[]) {
   Options opts;
   for (int argn = 1; argn < argc; argn++) {
     std::string arg(argv[argn]);
-    if (arg == "-h") {
+    if (arg == "--no-prefetch") {
+      opts.prefetch = false;
+    } else if (arg == "-o") {
+      argn++;
+      opts.output_file = argv[argn];
+    } else if (arg == "--append") {
+      opts.append = true;
+    } else if (arg == "-h") {
       usage(argv[0]);
       exit(1);
     } else {
@@ -1,5 +1,8 @@
 // local tools
+#include "Root/FilePrefetcher.h"
+#include "Root/OutputFile.h"
 #include "Root/TrackWriter.h"
+#include "Root/EventArena.h"
 
 // EDM things
 #include "xAODJet/JetContainer.h"
@@ -11,6 +14,7 @@
 
 // 3rd party includes
 #include "TFile.h"
+#include "TROOT.h"
 #include "H5Cpp.h"
 
 // stl includes
@@ -27,6 +31,9 @@
 struct Options
 {
   std::vector<std::string> files;
+  bool prefetch = true;
+  std::string output_file = "output.h5";
+  bool append = false;
 };
 // simple options parser
 Options get_options(int argc, char *argv[]);
@@ -40,19 +47,47 @@ int main (int argc, char *argv[])
   const char* ALG = argv[0];
   Options opts = get_options(argc, argv);
 
+  // The input files are opened on a background thread, so ROOT needs
+  // to know we're using threads before we do anything else with it.
+  if (opts.prefetch) ROOT::EnableThreadSafety();
+
   // set up xAOD basics
   RETURN_CHECK(ALG, xAOD::Init());
   xAOD::TEvent event(xAOD::TEvent::kClassAccess);
 
-  // set up output file
-  H5::H5File output("output.h5", H5F_ACC_TRUNC);
-  TrackWriter track_writer(output);
+  // Set up output file. If we're appending to an existing file we
+  // skip any inputs that are already in it. Anything that was written
+  // by a job that didn't finish is removed when the file is opened.
+  std::vector<std::string> files = uniqueInputs(opts.files);
+  H5::H5File output = openOutput(opts.output_file, opts.append);
+  if (opts.append) {
+    size_t n_inputs = files.size();
+    files = removeProcessed(files, readProvenance(output));
+    std::cout << "skipping " << n_inputs - files.size()
+              << " files that are already in the output" << std::endl;
+  }
+
+  // The H5Utils writers can only create new datasets, so we write
+  // them in a staging file and append them at the end of the job.
+  StagingFile staging(opts.output_file);
+
+  // Temporary objects for each event are allocated from this arena,
+  // which is cleared at the end of each event.
+  EventArena arena;
+  TrackWriter track_writer(staging.group(), arena);
+
+  // make sure we'll be able to append before we start
+  staging.check(output);
+
+  // The next file is opened in the background while we process the
+  // current one.
+  FilePrefetcher prefetcher(files, opts.prefetch);
 
   // Loop over the specified files:
-  for (std::string file_name: opts.files) {
+  for (std::string file_name: files) {
 
     // Open the file:
-    std::unique_ptr<TFile> ifile(TFile::Open(file_name.c_str(), "READ"));
+    std::unique_ptr<TFile> ifile = prefetcher.open(file_name);
     if ( ! ifile.get() || ifile->IsZombie()) {
       throw std::logic_error("Couldn't open file: " + file_name);
     }
@@ -82,9 +117,26 @@ int main (int argc, char *argv[])
         track_writer.write(*jet);
       }
 
+      // Everything we allocated in the arena is gone after this
+      arena.reset();
+
     } // end event loop
   } // end file loop
 
+  prefetcher.printSummary(std::cout);
+
+  // copy the new tracks into place, then record the files we've added
+  track_writer.flush();
+  staging.appendTo(output);
+  commitOutput(output, files);
+
+  // Print some information about the arena
+  const EventArena::Counters& counts = arena.counters();
+  std::cout << "arena: " << counts.allocations << " allocations ("
+            << counts.bytes << " bytes) over " << counts.resets
+            << " events, " << counts.heap_blocks << " heap blocks, "
+            << "peak " << counts.peak_bytes << " bytes per event"
+            << std::endl;
 
   return 0;
 }
@@ -92,14 +144,22 @@ int main (int argc, char *argv[])
 
 // define the options parser
 void usage(std::string name) {
-  std::cout << "usage: " << name << " [-h] <AOD>..." << std::endl;
+  std::cout << "usage: " << name << " [-h] [--no-prefetch]"
+    " [-o OUTPUT] [--append] <AOD>..." << std::endl;
 }
 
 Options get_options(int argc, char *argv[]) {
   Options opts;
   for (int argn = 1; argn < argc; argn++) {
     std::string arg(argv[argn]);
-    if (arg == "-h") {
+    if (arg == "--no-prefetch") {
+      opts.prefetch = false;
+    } else if (arg == "-o") {
+      argn++;
+      opts.output_file = argv[argn];
+    } else if (arg == "--append") {
+      opts.append = true;
+    } else if (arg == "-h") {
       usage(argv[0]);
       exit(1);
     } else {
@@ -0,0 +1,29 @@
+#include "Root/BTagInputs.h"
+
+// EDM
+#include "xAODJet/Jet.h"
+
+// C++ includes
+#include <algorithm>
+#include <cmath>
+
+const std::vector<std::string> BTagInputs::VARIABLES {
+  "rnnip_log_ratio", "jf_sig_log1p"};
+
+bool BTagInputs::provides(const std::string& name) {
+  return std::count(VARIABLES.begin(), VARIABLES.end(), name);
+}
+
+BTagInputs::BTagInputs():
+  m_rnnip_pu("rnnip_pu"),
+  m_rnnip_pb("rnnip_pb"),
+  m_jf_sig("JetFitter_significance3d")
+{
+}
+
+void BTagInputs::fill(const xAOD::Jet& jet,
+                      std::map<std::string, double>& inputs) const {
+  const SG::AuxElement* btag = jet.btagging();
+  inputs["rnnip_log_ratio"] = std::log(m_rnnip_pb(*btag) / m_rnnip_pu(*btag));
+  inputs["jf_sig_log1p"] = std::log1p(m_jf_sig(*btag));
+}
@@ -0,0 +1,50 @@
+#ifndef BTAG_INPUTS_H
+#define BTAG_INPUTS_H
+
+// forward declare EDM things
+namespace xAOD {
+  class Jet_v1;
+  typedef Jet_v1 Jet;
+}
+
+// EDM includes
+#include "AthContainers/AuxElement.h"
+
+// C++ includes
+#include <map>
+#include <string>
+#include <vector>
+
+//////////////////////////////////////////////////////////////////////
+// BTagInputs class
+//////////////////////////////////////////////////////////////////////
+//
+// Calculates the jet-level inputs to the network from the b-tagging
+// object. Both the classifier and the training dataset writer use
+// this, so that the two can't disagree on what the inputs are.
+//
+// Note that the names here are the names used in `variables.json`,
+// i.e. after the log1p or log ratio is taken. The offset and scale
+// are applied later.
+//
+// The values are written into an existing map. If the same map is
+// passed in for every jet the nodes are reused, so nothing has to be
+// allocated after the first jet.
+//
+class BTagInputs
+{
+public:
+  BTagInputs();
+  void fill(const xAOD::Jet& jet, std::map<std::string, double>&) const;
+
+  // names of all the variables that `fill` sets
+  static const std::vector<std::string> VARIABLES;
+  static bool provides(const std::string& name);
+private:
+  typedef SG::AuxElement AE;
+  AE::ConstAccessor<double> m_rnnip_pu;
+  AE::ConstAccessor<double> m_rnnip_pb;
+  AE::ConstAccessor<float> m_jf_sig;
+};
+
+#endif
@@ -0,0 +1,236 @@
+#include "Root/FieldStats.h"
+#include "Root/Appendable.h"
+
+// C++ includes
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <stdexcept>
+
+namespace {
+  // write a scalar attribute
+  template <typename T>
+  void add_attr(H5::Group& group, const std::string& name,
+                const H5::PredType& type, T value) {
+    H5::DataSpace scalar;
+    group.createAttribute(name, type, scalar).write(type, &value);
+  }
+  template <typename T>
+  T get_attr(const H5::H5Object& obj, const std::string& name,
+             const H5::PredType& type) {
+    T value;
+    obj.openAttribute(name).read(type, &value);
+    return value;
+  }
+  void move_link(H5::Group& group, const std::string& from,
+                 const std::string& to) {
+    if (H5Lmove(group.getId(), from.c_str(), group.getId(), to.c_str(),
+                H5P_DEFAULT, H5P_DEFAULT) < 0) {
+      throw std::runtime_error("can't move " + from + " to " + to);
+    }
+  }
+}
+
+const std::vector<int> FieldStats::FLAVORS {0, 4, 5};
+
+FieldStats::FieldStats(double low, double high, int n_bins):
+  m_low(low),
+  m_high(high),
+  m_n_bins(n_bins),
+  m_count(0),
+  m_nan_count(0),
+  m_inf_count(0),
+  m_mean(0),
+  m_m2(0),
+  m_min(std::numeric_limits<double>::infinity()),
+  m_max(-std::numeric_limits<double>::infinity()),
+  m_hist((FLAVORS.size() + 1) * (n_bins + 2), 0),
+  m_partial(false)
+{
+}
+
+void FieldStats::fill(double value, int label) {
+  m_count++;
+  if (std::isnan(value)) {
+    m_nan_count++;
+    return;
+  }
+
+  // find the bin: 0 is underflow, n_bins + 1 is overflow
+  int bin = 0;
+  if (value >= m_high) {
+    bin = m_n_bins + 1;
+  } else if (value >= m_low) {
+    int n = static_cast<int>((value - m_low) / (m_high - m_low) * m_n_bins);
+    bin = 1 + std::min(n, m_n_bins - 1);
+  }
+  m_hist.at(flavorIndex(label) * (m_n_bins + 2) + bin)++;
+
+  if (std::isinf(value)) {
+    m_inf_count++;
+    return;
+  }
+  m_min = std::min(m_min, value);
+  m_max = std::max(m_max, value);
+  unsigned long long n = m_count - m_nan_count - m_inf_count;
+  double delta = value - m_mean;
+  m_mean += delta / n;
+  m_m2 += delta * (value - m_mean);
+}
+
+void FieldStats::write(H5::Group& group) const {
+  using H5::PredType;
+  unsigned long long n_finite = m_count - m_nan_count - m_inf_count;
+  double variance = n_finite > 1 ? m_m2 / (n_finite - 1) : NAN;
+  add_attr(group, "count", PredType::NATIVE_ULLONG, m_count);
+  add_attr(group, "nan_count", PredType::NATIVE_ULLONG, m_nan_count);
+  add_attr(group, "inf_count", PredType::NATIVE_ULLONG, m_inf_count);
+  add_attr(group, "mean", PredType::NATIVE_DOUBLE, n_finite ? m_mean : NAN);
+  add_attr(group, "variance", PredType::NATIVE_DOUBLE, variance);
+  add_attr(group, "min", PredType::NATIVE_DOUBLE, n_finite ? m_min : NAN);
+  add_attr(group, "max", PredType::NATIVE_DOUBLE, n_finite ? m_max : NAN);
+  add_attr(group, "partial", PredType::NATIVE_INT, int(m_partial));
+
+  // The histogram is a 2d array with one row per flavor. The last row
+  // is everything that didn't match one of the flavors.
+  hsize_t dims[2] = {FLAVORS.size() + 1, hsize_t(m_n_bins + 2)};
+  H5::DataSpace space(2, dims);
+  H5::DataSet hist = group.createDataSet(
+    "hist", PredType::NATIVE_ULLONG, space);
+  hist.write(m_hist.data(), PredType::NATIVE_ULLONG);
+
+  hsize_t n_flavors[1] = {FLAVORS.size()};
+  H5::DataSpace flavor_space(1, n_flavors);
+  hist.createAttribute("flavors", PredType::NATIVE_INT, flavor_space)
+    .write(PredType::NATIVE_INT, FLAVORS.data());
+  H5::DataSpace scalar;
+  hist.createAttribute("low", PredType::NATIVE_DOUBLE, scalar)
+    .write(PredType::NATIVE_DOUBLE, &m_low);
+  hist.createAttribute("high", PredType::NATIVE_DOUBLE, scalar)
+    .write(PredType::NATIVE_DOUBLE, &m_high);
+}
+
+void FieldStats::merge(const H5::Group& group) {
+  using H5::PredType;
+
+  // we can only add histograms with the same binning
+  H5::DataSet hist = group.openDataSet("hist");
+  hsize_t dims[2];
+  hist.getSpace().getSimpleExtentDims(dims);
+  H5::Attribute flavor_attr = hist.openAttribute("flavors");
+  std::vector<int> flavors(flavor_attr.getSpace().getSimpleExtentNpoints());
+  flavor_attr.read(PredType::NATIVE_INT, flavors.data());
+  if (get_attr<double>(hist, "low", PredType::NATIVE_DOUBLE) != m_low ||
+      get_attr<double>(hist, "high", PredType::NATIVE_DOUBLE) != m_high ||
+      flavors != FLAVORS || dims[0] != FLAVORS.size() + 1 ||
+      dims[1] != hsize_t(m_n_bins + 2)) {
+    throw std::logic_error("can't merge histograms with different binning");
+  }
+  std::vector<unsigned long long> other(m_hist.size());
+  hist.read(other.data(), PredType::NATIVE_ULLONG);
+  for (size_t bin = 0; bin < m_hist.size(); bin++) m_hist[bin] += other[bin];
+
+  if (group.attrExists("partial") &&
+      get_attr<int>(group, "partial", PredType::NATIVE_INT)) {
+    m_partial = true;
+  }
+
+  auto ullong = PredType::NATIVE_ULLONG;
+  auto dbl = PredType::NATIVE_DOUBLE;
+  unsigned long long count = get_attr<unsigned long long>(
+    group, "count", ullong);
+  unsigned long long nan_count = get_attr<unsigned long long>(
+    group, "nan_count", ullong);
+  unsigned long long inf_count = get_attr<unsigned long long>(
+    group, "inf_count", ullong);
+  unsigned long long n_b = count - nan_count - inf_count;
+  unsigned long long n_a = m_count - m_nan_count - m_inf_count;
+  m_count += count;
+  m_nan_count += nan_count;
+  m_inf_count += inf_count;
+  if (n_b == 0) return;
+
+  // Combine the means and variances, see
+  // https://en.wikipedia.org/wiki/Algorithms_for_calculating_variance
+  double mean_b = get_attr<double>(group, "mean", dbl);
+  double variance_b = get_attr<double>(group, "variance", dbl);
+  double m2_b = n_b > 1 ? variance_b * (n_b - 1) : 0;
+  double n = n_a + n_b;
+  double delta = mean_b - m_mean;
+  m_mean += delta * n_b / n;
+  m_m2 += m2_b + delta * delta * n_a * n_b / n;
+  m_min = std::min(m_min, get_attr<double>(group, "min", dbl));
+  m_max = std::max(m_max, get_attr<double>(group, "max", dbl));
+}
+
+unsigned long long FieldStats::count() const {
+  return m_count;
+}
+
+void FieldStats::markPartial() {
+  m_partial = true;
+}
+
+size_t FieldStats::flavorIndex(int label) const {
+  auto pos = std::find(FLAVORS.begin(), FLAVORS.end(), label);
+  return pos - FLAVORS.begin();
+}
+
+OutputStats::OutputStats():
+  m_label("HadronConeExclExtendedTruthLabelID")
+{
+}
+
+void OutputStats::write(H5::Group& output,
+                        unsigned long long n_jets) const {
+  // We don't change the old statistics in place: if the job died
+  // halfway through we'd lose them. Instead the combined statistics
+  // are written to a new group, which replaces the old one at the
+  // end. If we find a new group but no old one, the job died after
+  // removing the old one, so the new one is complete. If we find both
+  // the new one might not be.
+  const std::string name = "stats";
+  const std::string new_name = "stats.new";
+  if (exists(output, new_name)) {
+    if (exists(output, name)) {
+      output.unlink(new_name);
+    } else {
+      move_link(output, new_name, name);
+    }
+  }
+
+  bool has_old = exists(output, name);
+  H5::Group old_group = has_old ? output.openGroup(name) : H5::Group();
+  H5::Group new_group = output.createGroup(new_name);
+  for (const auto& stats: m_stats) {
+    // combine with anything that's already in the file
+    FieldStats merged(*stats.second);
+    if (has_old && exists(old_group, stats.first)) {
+      merged.merge(old_group.openGroup(stats.first));
+    }
+    if (merged.count() != n_jets) merged.markPartial();
+    H5::Group group = new_group.createGroup(stats.first);
+    merged.write(group);
+  }
+
+  // Keep the statistics for any variables we didn't write this time.
+  // They don't cover the new jets, so they're partial now.
+  if (has_old) {
+    for (hsize_t i = 0; i < old_group.getNumObjs(); i++) {
+      std::string var = old_group.getObjnameByIdx(i);
+      if (m_stats.count(var)) continue;
+      if (H5Ocopy(old_group.getId(), var.c_str(), new_group.getId(),
+                  var.c_str(), H5P_DEFAULT, H5P_DEFAULT) < 0) {
+        throw std::runtime_error("can't copy the statistics for " + var);
+      }
+      H5::Group group = new_group.openGroup(var);
+      auto ullong = H5::PredType::NATIVE_ULLONG;
+      if (get_attr<unsigned long long>(group, "count", ullong) != n_jets) {
+        if (group.attrExists("partial")) group.removeAttr("partial");
+        add_attr(group, "partial", H5::PredType::NATIVE_INT, 1);
+      }
+    }
+  }
+  if (has_old) output.unlink(name);
+  move_link(output, new_name, name);
+}
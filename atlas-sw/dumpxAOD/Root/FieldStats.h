@@ -0,0 +1,113 @@
+#ifndef FIELD_STATS_H
+#define FIELD_STATS_H
+
+//////////////////////////////////////////////////////////////////////
+// FieldStats and OutputStats classes
+//////////////////////////////////////////////////////////////////////
+//
+// These keep track of some statistics on each variable as we write
+// it, so that we can check the output without reading it all back
+// in. For each variable we store:
+//
+//  - the number of entries, and how many were NaN or infinite
+//  - the mean and variance (of the finite values)
+//  - the min and max
+//  - a histogram for each jet flavor
+//
+// These are saved in a `stats` group in the output file, one
+// subgroup per variable. If we're appending to a file that already
+// has statistics, the old and new ones are combined. The statistics
+// are written after the jets are committed (see OutputFile.h), so
+// they never count jets that a later job would remove. If the
+// statistics for a variable don't cover every jet in the file (i.e.
+// we appended to a file that didn't have them, or a job died before
+// it wrote them) they are marked as `partial`.
+//
+// The statistics are filled with the value that's actually stored,
+// i.e. after it's converted to the output type.
+//
+//////////////////////////////////////////////////////////////////////
+
+// EDM includes
+#include "AthContainers/AuxElement.h"
+#include "xAODJet/Jet.h"
+
+// HDF5
+#include "H5Cpp.h"
+
+// C++ includes
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+class FieldStats
+{
+public:
+  // the histogram has `n_bins` bins between `low` and `high`, plus
+  // underflow and overflow
+  FieldStats(double low, double high, int n_bins);
+  void fill(double value, int label);
+  void write(H5::Group& group) const;
+  // add the statistics that were saved in a group by `write`
+  void merge(const H5::Group& group);
+  unsigned long long count() const;
+  void markPartial();
+private:
+  // these are the flavors we split the histogram by, anything else
+  // goes in the last row
+  static const std::vector<int> FLAVORS;
+  size_t flavorIndex(int label) const;
+
+  double m_low;
+  double m_high;
+  int m_n_bins;
+
+  unsigned long long m_count;
+  unsigned long long m_nan_count;
+  unsigned long long m_inf_count;
+  // Welford's algorithm: running mean and sum of squared differences
+  double m_mean;
+  double m_m2;
+  double m_min;
+  double m_max;
+  // one row per flavor, one column per bin
+  std::vector<unsigned long long> m_hist;
+  // true if these don't cover all the jets in the output
+  bool m_partial;
+};
+
+class OutputStats
+{
+public:
+  OutputStats();
+
+  // Wrap a consumer function so that it also fills the statistics
+  // for this variable. The result can be passed to Consumers::add,
+  // and `T` should be the type it's added with.
+  template <typename T, typename F>
+  auto wrap(const std::string& name, F func,
+            double low, double high, int n_bins = 100);
+
+  // Write the statistics. `n_jets` is the number of jets in the
+  // output, anything that doesn't cover all of them is partial.
+  void write(H5::Group& output, unsigned long long n_jets) const;
+private:
+  SG::AuxElement::ConstAccessor<int> m_label;
+  std::map<std::string, std::shared_ptr<FieldStats> > m_stats;
+};
+
+template <typename T, typename F>
+auto OutputStats::wrap(const std::string& name, F func,
+                       double low, double high, int n_bins) {
+  auto stats = std::make_shared<FieldStats>(low, high, n_bins);
+  m_stats[name] = stats;
+  auto label = m_label;
+  return [func, stats, label](const xAOD::Jet& jet) {
+           T value = func(jet);
+           stats->fill(value, label(jet));
+           return value;
+         };
+}
+
+#endif
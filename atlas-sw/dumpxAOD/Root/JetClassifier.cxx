@@ -2,63 +2,154 @@
 
 // EDM
 #include "xAODJet/Jet.h"
+#include "xAODTracking/TrackParticle.h"
 
 // Externals
 #include "lwtnn/LightweightGraph.hh"
-#include "lwtnn/NanReplacer.hh"
 #include "lwtnn/parse_json.hh"
 
+// ROOT
+#include "TVector2.h"
+
 // C++ includes
 #include <stdexcept>
 #include <map>
 #include <string>
 #include <cmath>
+#include <algorithm>
+
+namespace {
+  // These are all the track variables that a sequence input can ask
+  // for. If you train a network on some new track variable you'll
+  // have to add it here as well.
+  typedef xAOD::Jet J;
+  typedef xAOD::TrackParticle T;
+  typedef std::function<double(const J&, const T&)> TrackVar;
+  const std::map<std::string, TrackVar> TRACK_VARIABLES {
+    {"pt", [](const J&, const T& t) { return t.pt(); }},
+    {"log_pt", [](const J&, const T& t) { return std::log(t.pt()); }},
+    {"ptfrac", [](const J& j, const T& t) { return t.pt() / j.pt(); }},
+    {"eta", [](const J&, const T& t) { return t.eta(); }},
+    {"deta", [](const J& j, const T& t) { return t.eta() - j.eta(); }},
+    {"dphi", [](const J& j, const T& t) {
+               return TVector2::Phi_mpi_pi(t.phi() - j.phi()); }},
+    {"deltaR", [](const J& j, const T& t) {
+                 double deta = t.eta() - j.eta();
+                 double dphi = TVector2::Phi_mpi_pi(t.phi() - j.phi());
+                 return std::hypot(deta, dphi); }}
+  };
+}
 
 JetClassifier::JetClassifier(std::istream& stream):
-  m_rnnip_pu("rnnip_pu"),
-  m_rnnip_pb("rnnip_pb"),
-  m_jf_sig("JetFitter_significance3d"),
+  m_ghost_accessor("GhostTrack"),
   m_nn_light("nn_light"),
   m_nn_charm("nn_charm"),
   m_nn_bottom("nn_bottom"),
-  m_graph(nullptr),
-  m_replacer(nullptr)
+  m_graph(nullptr)
 {
   lwt::GraphConfig config = lwt::parse_json_graph(stream);
   m_graph.reset(new lwt::LightweightGraph(config));
-  if (config.inputs.size() != 1) {
+
+  // We allow at most one "flat" input node, which is filled with the
+  // jet-level b-tagging variables. Check that BTagInputs gives us
+  // every variable it asks for.
+  if (config.inputs.size() > 1) {
     throw std::logic_error("only one input node allowed");
   }
-  m_replacer.reset(
-    new lwt::NanReplacer(config.inputs.at(0).defaults, lwt::rep::all));
+  if (config.inputs.size() == 1) {
+    const auto& node = config.inputs.at(0);
+    for (const auto& var: node.variables) {
+      if (!BTagInputs::provides(var.name)) {
+        throw std::logic_error("unknown jet variable: " + var.name);
+      }
+    }
+    m_input_node = node.name;
+    m_defaults = node.defaults;
+  }
+
+  // Any number of sequence nodes are allowed. Here we just check that
+  // we know how to calculate every variable they ask for.
+  for (const auto& node: config.input_sequences) {
+    m_seq_nodes.push_back(node.name);
+    for (const auto& var: node.variables) {
+      if (!TRACK_VARIABLES.count(var.name)) {
+        throw std::logic_error("unknown track variable: " + var.name);
+      }
+      // only calculate each variable once, even if it's used twice
+      auto same = [&var](const TrackInput& in) {return in.name == var.name;};
+      if (std::none_of(m_track_inputs.begin(), m_track_inputs.end(), same)) {
+        m_track_inputs.push_back({var.name, TRACK_VARIABLES.at(var.name)});
+      }
+    }
+  }
+  if (config.inputs.empty() && config.input_sequences.empty()) {
+    throw std::logic_error("no inputs in network");
+  }
 }
 
-void JetClassifier::decorate(const xAOD::Jet& jet) const {
+JetClassifier::~JetClassifier() = default;
 
-  // access input variables
+void JetClassifier::decorate(const xAOD::Jet& jet) {
+
+  // outputs are stored on the b-tagging object
   const SG::AuxElement* btag = jet.btagging();
-  double rnnip_log_ratio = std::log(m_rnnip_pb(*btag) / m_rnnip_pu(*btag));
-  double jf_sig_log1p = std::log1p(m_jf_sig(*btag));
-
-  // Replace any NaN values in the input map with the default values.
-  // these are expected when rnnip doesn't find tracks and returns all
-  // zeros.
-  auto input_map = m_replacer->replace({
-      {"jf_sig_log1p", jf_sig_log1p},
-      {"rnnip_log_ratio", rnnip_log_ratio}
-    });
-  // Build them into a map. The outer map indexes input nodes, whereas
-  // the inner map indexes the individual inputs to each node. In this
-  // simple case we only have one input node.
-  std::map<std::string, std::map<std::string, double> > inputs {
-    {"btag_variables", input_map}};
 
+  // The inputs are a map of maps. The outer map indexes input nodes,
+  // whereas the inner map indexes the individual inputs to each node.
+  if (!m_input_node.empty()) {
+    std::map<std::string, double>& input_map = m_inputs[m_input_node];
+    m_btag_inputs.fill(jet, input_map);
+    // Replace any NaN values in the input map with the default
+    // values. these are expected when rnnip doesn't find tracks and
+    // returns all zeros.
+    for (const auto& def: m_defaults) {
+      auto value = input_map.find(def.first);
+      if (value == input_map.end()) continue;
+      if (!std::isfinite(value->second)) value->second = def.second;
+    }
+  }
+
+  // Build the sequence inputs. Each variable is one contiguous array
+  // with one entry per track, so there's no padding: a jet with three
+  // tracks gives the recurrent layers exactly three steps.
+  if (!m_seq_nodes.empty()) {
+    fillTracks(jet);
+    for (const auto& input: m_track_inputs) {
+      std::vector<double>& values = m_track_vars[input.name];
+      values.clear();
+      for (const auto* track: m_tracks) {
+        values.push_back(input.func(jet, *track));
+      }
+    }
+    // assigning to the existing vectors reuses their memory
+    for (const auto& node: m_seq_nodes) {
+      SeqMap& node_vars = m_seqs[node];
+      for (const auto& var: m_track_vars) node_vars[var.first] = var.second;
+    }
+  }
 
   // calculate output scores
-  auto out_classes = m_graph->compute(inputs);
+  auto out_classes = m_graph->compute(m_inputs, m_seqs);
 
   // store outputs in the jet
   m_nn_light(*btag) = out_classes.at("light");
   m_nn_charm(*btag) = out_classes.at("charm");
   m_nn_bottom(*btag) = out_classes.at("bottom");
 }
+
+// This follows the TrackWriter in the advanced examples: we read the
+// ghost associated tracks and sort them by descending pt, since
+// that's the order the sequences are given to the network.
+void JetClassifier::fillTracks(const xAOD::Jet& jet) {
+  m_tracks.clear();
+  for (const auto& link: m_ghost_accessor(jet)) {
+    if (!link.isValid()) throw std::logic_error("invalid particle link");
+    const auto* track = dynamic_cast<const xAOD::TrackParticle*>(*link);
+    if (!track) throw std::logic_error("particle is not a TrackParticle");
+    m_tracks.push_back(track);
+  }
+  std::sort(m_tracks.begin(), m_tracks.end(),
+            [](const auto* t1, const auto* t2) {
+              return t1->pt() > t2->pt();
+            });
+}
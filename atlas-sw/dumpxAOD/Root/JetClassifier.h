@@ -5,41 +5,85 @@
 namespace xAOD {
   class Jet_v1;
   typedef Jet_v1 Jet;
+  class TrackParticle_v1;
+  typedef TrackParticle_v1 TrackParticle;
 }
 // forward declare lwtnn things
 namespace lwt {
   class LightweightGraph;
-  class NanReplacer;
 }
 
+// local includes
+#include "Root/BTagInputs.h"
+
 // EDM includes
 #include "AthContainers/AuxElement.h"
+#include "AthLinks/ElementLink.h"
+#include "xAODBase/IParticleContainer.h"
 
 // C++ includes
 #include <istream>
 #include <memory>
+#include <functional>
+#include <string>
+#include <vector>
+#include <map>
 
 class JetClassifier
 {
 public:
   JetClassifier(std::istream& input_config);
-  void decorate(const xAOD::Jet& jet) const;
+  ~JetClassifier();
+
+  // This isn't const, since the input buffers are reused between
+  // calls. For the same reason it isn't thread safe.
+  void decorate(const xAOD::Jet& jet);
 
 private:
-  // accessors for input variabls
+  // input variables
   typedef SG::AuxElement AE;
-  AE::ConstAccessor<double> m_rnnip_pu;
-  AE::ConstAccessor<double> m_rnnip_pb;
-  AE::ConstAccessor<float> m_jf_sig;
+  BTagInputs m_btag_inputs;
+
+  // accessor for the tracks that feed sequence inputs
+  typedef std::vector<ElementLink<xAOD::IParticleContainer> > PartLinks;
+  AE::ConstAccessor<PartLinks> m_ghost_accessor;
 
   // decorators for outputs
   AE::Decorator<float> m_nn_light;
   AE::Decorator<float> m_nn_charm;
   AE::Decorator<float> m_nn_bottom;
 
-  // lightweight graph and preprocessor
+  // lightweight graph and default values for the inputs
   std::unique_ptr<lwt::LightweightGraph> m_graph;
-  std::unique_ptr<lwt::NanReplacer> m_replacer;
+  std::map<std::string, double> m_defaults;
+
+  // Sequence inputs are built from the tracks in the jet. Each
+  // variable is a function of the jet and one track, and is only
+  // calculated once per track even if several sequence nodes use it.
+  typedef std::function<double(const xAOD::Jet&,
+                               const xAOD::TrackParticle&)> TrackVar;
+  struct TrackInput
+  {
+    std::string name;
+    TrackVar func;
+  };
+  std::vector<TrackInput> m_track_inputs;
+
+  // names of the input nodes in the graph
+  std::string m_input_node;
+  std::vector<std::string> m_seq_nodes;
+
+  // Buffers for the inputs. These are filled in place for each jet,
+  // so after the first few jets the maps and vectors are big enough
+  // and we stop allocating memory.
+  typedef std::map<std::string, std::vector<double> > SeqMap;
+  std::map<std::string, std::map<std::string, double> > m_inputs;
+  std::map<std::string, SeqMap> m_seqs;
+  SeqMap m_track_vars;
+  std::vector<const xAOD::TrackParticle*> m_tracks;
+
+  // get the tracks in the jet, sorted by descending pt
+  void fillTracks(const xAOD::Jet&);
 };
 
 #endif
@@ -0,0 +1,354 @@
+#include "Root/TrainingWriter.h"
+#include "Root/Appendable.h"
+
+// EDM
+#include "xAODJet/Jet.h"
+
+// Externals
+#include <boost/property_tree/ptree.hpp>
+#include <boost/property_tree/json_parser.hpp>
+
+// C++ includes
+#include <stdexcept>
+#include <map>
+#include <cmath>
+#include <numeric>
+#include <algorithm>
+#include <cstdint>
+
+namespace {
+
+  // These are the names `train_nn.py` gives the output classes, and
+  // the truth labels they correspond to.
+  const std::map<std::string, int> CLASS_LABELS {
+    {"light", 0}, {"charm", 4}, {"bottom", 5} };
+
+  // Build an extensible 2d dataset with `n_columns` columns. The
+  // chunks are `chunk_size` rows long, and we don't compress them:
+  // these datasets are meant to be read fast, not stored forever.
+  H5::DSetCreatPropList dataset_props(hsize_t n_columns, hsize_t chunk_size) {
+    H5::DSetCreatPropList props;
+    hsize_t chunks[2] = {chunk_size, n_columns};
+    props.setChunk(2, chunks);
+    return props;
+  }
+  H5::DataSet make_dataset(H5::Group& group, const std::string& name,
+                           const H5::DataType& type,
+                           hsize_t n_columns, hsize_t chunk_size) {
+    hsize_t dims[2] = {0, n_columns};
+    hsize_t max_dims[2] = {H5S_UNLIMITED, n_columns};
+    H5::DataSpace space(2, dims, max_dims);
+    return group.createDataSet(name, type, space,
+                               dataset_props(n_columns, chunk_size));
+  }
+
+  // If we're appending to an existing dataset, check that it was
+  // written the same way.
+  H5::DataSet open_dataset(H5::Group& group, const std::string& name,
+                           const H5::DataType& type,
+                           hsize_t n_columns, hsize_t chunk_size) {
+    H5::DataSet ds = group.openDataSet(name);
+    checkAppendable(ds, type, dataset_props(n_columns, chunk_size),
+                    {n_columns});
+    return ds;
+  }
+
+  // add an attribute with a list of names, i.e. the names of the
+  // columns in a dataset
+  void add_names(H5::DataSet& ds, const std::string& attr_name,
+                 const std::vector<std::string>& names) {
+    std::vector<const char*> c_names;
+    for (const auto& name: names) c_names.push_back(name.c_str());
+    H5::StrType type(H5::PredType::C_S1, H5T_VARIABLE);
+    hsize_t dims[1] = {c_names.size()};
+    H5::DataSpace space(1, dims);
+    ds.createAttribute(attr_name, type, space).write(type, c_names.data());
+  }
+  // same thing for a list of numbers, i.e. the offset for each
+  // column
+  void add_values(H5::DataSet& ds, const std::string& attr_name,
+                  const std::vector<double>& values) {
+    hsize_t dims[1] = {values.size()};
+    H5::DataSpace space(1, dims);
+    ds.createAttribute(attr_name, H5::PredType::NATIVE_DOUBLE, space)
+      .write(H5::PredType::NATIVE_DOUBLE, values.data());
+  }
+  std::vector<double> read_values(const H5::DataSet& ds,
+                                  const std::string& attr_name) {
+    if (!ds.attrExists(attr_name)) return {};
+    H5::Attribute attr = ds.openAttribute(attr_name);
+    std::vector<double> values(attr.getSpace().getSimpleExtentNpoints());
+    attr.read(H5::PredType::NATIVE_DOUBLE, values.data());
+    return values;
+  }
+  std::vector<std::string> read_names(const H5::DataSet& ds,
+                                      const std::string& attr_name) {
+    H5::Attribute attr = ds.openAttribute(attr_name);
+    H5::DataSpace space = attr.getSpace();
+    std::vector<char*> c_names(space.getSimpleExtentNpoints());
+    H5::StrType type(H5::PredType::C_S1, H5T_VARIABLE);
+    attr.read(type, c_names.data());
+    std::vector<std::string> names(c_names.begin(), c_names.end());
+    H5::DataSet::vlenReclaim(c_names.data(), type, space);
+    return names;
+  }
+
+  // reorder the rows of a flat 2d buffer
+  template <typename T>
+  std::vector<T> permute(const std::vector<T>& buffer,
+                         const std::vector<hsize_t>& order) {
+    std::vector<T> out;
+    out.reserve(buffer.capacity());
+    const size_t n_columns = buffer.size() / order.size();
+    for (hsize_t row: order) {
+      auto begin = buffer.begin() + row * n_columns;
+      out.insert(out.end(), begin, begin + n_columns);
+    }
+    return out;
+  }
+
+  // The standard library shuffle and distributions are allowed to
+  // give different results in different implementations, so we use
+  // our own to keep the output the same everywhere. The generator
+  // itself is fully specified by the standard.
+  //
+  // uniform double in [0, 1), from the top 53 bits
+  double uniform(std::mt19937_64& random) {
+    return (random() >> 11) * (1.0 / 9007199254740992.0);
+  }
+  // uniform integer in [0, n), rejecting the values that would make
+  // the low numbers a bit more likely
+  hsize_t uniform_index(std::mt19937_64& random, hsize_t n) {
+    const unsigned long long max = std::mt19937_64::max();
+    const unsigned long long limit = max - max % n;
+    unsigned long long value;
+    do {
+      value = random();
+    } while (value >= limit);
+    return value % n;
+  }
+
+  // Add a seed to the end of the `seeds` dataset, and return the row
+  // it went in. This is marked as appendable like the other datasets,
+  // so a run that doesn't finish doesn't leave its seed behind.
+  hsize_t append_seed(H5::Group& group, unsigned long long seed) {
+    const H5::PredType& type = H5::PredType::NATIVE_ULLONG;
+    H5::DataSet ds;
+    if (exists(group, "seeds")) {
+      ds = group.openDataSet("seeds");
+    } else {
+      hsize_t dims[1] = {0};
+      hsize_t max_dims[1] = {H5S_UNLIMITED};
+      H5::DataSpace space(1, dims, max_dims);
+      H5::DSetCreatPropList props;
+      hsize_t chunks[1] = {64};
+      props.setChunk(1, chunks);
+      ds = group.createDataSet("seeds", type, space, props);
+    }
+    markAppendable(ds);
+    hsize_t run = datasetDims(ds).at(0);
+    hsize_t new_dims[1] = {run + 1};
+    ds.extend(new_dims);
+    H5::DataSpace file_space = ds.getSpace();
+    hsize_t start[1] = {run};
+    hsize_t count[1] = {1};
+    file_space.selectHyperslab(H5S_SELECT_SET, count, start);
+    H5::DataSpace mem_space(1, count);
+    ds.write(&seed, type, mem_space, file_space);
+    return run;
+  }
+
+  // append `n_rows` rows from `buffer` to the end of `ds`
+  template <typename T>
+  void append(H5::DataSet& ds, const H5::DataType& type,
+              const std::vector<T>& buffer, hsize_t offset, hsize_t n_rows) {
+    H5::DataSpace file_space = ds.getSpace();
+    hsize_t dims[2];
+    file_space.getSimpleExtentDims(dims);
+    hsize_t new_dims[2] = {offset + n_rows, dims[1]};
+    ds.extend(new_dims);
+    file_space = ds.getSpace();
+    hsize_t start[2] = {offset, 0};
+    hsize_t count[2] = {n_rows, dims[1]};
+    file_space.selectHyperslab(H5S_SELECT_SET, count, start);
+    H5::DataSpace mem_space(2, count);
+    ds.write(buffer.data(), type, mem_space, file_space);
+  }
+}
+
+TrainingWriter::TrainingWriter(H5::Group& output_group,
+                               std::istream& variables,
+                               const TrainingConfig& cfg):
+  m_label("HadronConeExclExtendedTruthLabelID"),
+  m_chunk_size(cfg.chunk_size),
+  m_buffer_size(cfg.chunk_size),
+  m_n_written(0),
+  m_shuffle(cfg.shuffle_window > 0),
+  m_keep_fraction(cfg.keep_fraction)
+{
+  namespace pt = boost::property_tree;
+  pt::ptree config;
+  pt::read_json(variables, config);
+
+  // Read the input variables. Like the classifier, we only support
+  // one input node here, and every variable has to come from
+  // BTagInputs. Every variable also needs a default: otherwise we'd
+  // be writing NaN or inf into the training inputs.
+  const pt::ptree& inputs = config.get_child("inputs");
+  if (inputs.size() != 1) {
+    throw std::logic_error("only one input node allowed");
+  }
+  std::vector<std::string> var_names;
+  std::vector<double> offsets, scales, defaults;
+  for (const auto& var: inputs.front().second.get_child("variables")) {
+    const pt::ptree& v = var.second;
+    std::string name = v.get<std::string>("name");
+    if (!BTagInputs::provides(name)) {
+      throw std::logic_error("unknown jet variable: " + name);
+    }
+    double default_value = v.get<double>("default", NAN);
+    if (!std::isfinite(default_value)) {
+      throw std::logic_error("no default for variable: " + name);
+    }
+    m_variables.push_back({
+        name,
+        v.get<double>("offset"),
+        v.get<double>("scale"),
+        default_value});
+    var_names.push_back(name);
+    offsets.push_back(m_variables.back().offset);
+    scales.push_back(m_variables.back().scale);
+    defaults.push_back(default_value);
+  }
+
+  // Read the output classes
+  std::vector<std::string> class_names;
+  for (const auto& label: config.get_child("outputs").front().second
+         .get_child("labels")) {
+    std::string name = label.second.get_value<std::string>();
+    if (!CLASS_LABELS.count(name)) {
+      throw std::logic_error("unknown output class: " + name);
+    }
+    m_labels.push_back(CLASS_LABELS.at(name));
+    class_names.push_back(name);
+  }
+  if (m_labels.empty()) throw std::logic_error("no output classes");
+
+  // If there's already a training dataset we add the new jets to the
+  // end, but only if it has the same inputs and outputs, with the
+  // same transformations. These are saved with the dataset so that
+  // `train_nn.py` can write out the `variables.json` that matches
+  // the inputs it was trained on.
+  const H5::PredType& float_type = H5::PredType::NATIVE_FLOAT;
+  const H5::PredType& int_type = H5::PredType::NATIVE_INT;
+  bool append = exists(output_group, "training");
+  if (!append) output_group.createGroup("training");
+  H5::Group group = output_group.openGroup("training");
+  if (append) {
+    m_inputs = open_dataset(group, "inputs", float_type,
+                            m_variables.size(), m_chunk_size);
+    m_targets = open_dataset(group, "targets", int_type,
+                             m_labels.size(), m_chunk_size);
+    if (read_names(m_inputs, "variables") != var_names ||
+        read_values(m_inputs, "offsets") != offsets ||
+        read_values(m_inputs, "scales") != scales ||
+        read_values(m_inputs, "defaults") != defaults ||
+        read_names(m_targets, "classes") != class_names) {
+      throw std::logic_error("training inputs don't match existing output");
+    }
+    hsize_t dims[2];
+    m_inputs.getSpace().getSimpleExtentDims(dims);
+    m_n_written = dims[0];
+  } else {
+    m_inputs = make_dataset(group, "inputs", float_type,
+                            m_variables.size(), m_chunk_size);
+    add_names(m_inputs, "variables", var_names);
+    add_values(m_inputs, "offsets", offsets);
+    add_values(m_inputs, "scales", scales);
+    add_values(m_inputs, "defaults", defaults);
+    m_targets = make_dataset(group, "targets", int_type,
+                             m_labels.size(), m_chunk_size);
+    add_names(m_targets, "classes", class_names);
+  }
+  markAppendable(m_inputs);
+  markAppendable(m_targets);
+
+  // Save the seed for each run, so that the output can be
+  // reproduced. The generator is seeded with both the seed and the
+  // run number (i.e. the row in `seeds`), so that appending twice
+  // with the same seed doesn't repeat the same random numbers. Like
+  // the generator, std::seed_seq is the same everywhere.
+  hsize_t run = append_seed(group, cfg.seed);
+  std::seed_seq seeds {
+    uint_least32_t(cfg.seed), uint_least32_t(cfg.seed >> 32),
+    uint_least32_t(run)};
+  m_random.seed(seeds);
+
+  // When we shuffle we have to keep a whole window in memory. We
+  // round it up to a whole number of chunks so that the chunks stay
+  // aligned.
+  if (m_shuffle) {
+    hsize_t n_chunks = (cfg.shuffle_window + m_chunk_size - 1) / m_chunk_size;
+    m_buffer_size = n_chunks * m_chunk_size;
+  }
+  m_input_buffer.reserve(m_buffer_size * m_variables.size());
+  m_target_buffer.reserve(m_buffer_size * m_labels.size());
+}
+
+TrainingWriter::~TrainingWriter() {
+  flush();
+}
+
+void TrainingWriter::write(const xAOD::Jet& jet) {
+
+  // Randomly drop some jets, depending on their flavor.
+  int label = m_label(jet);
+  auto keep = m_keep_fraction.find(label);
+  if (keep != m_keep_fraction.end()) {
+    if (uniform(m_random) >= keep->second) return;
+  }
+
+  // Apply the same transformations as the classifier: replace NaN
+  // and inf with the default, then shift and scale.
+  m_btag_inputs.fill(jet, m_raw_inputs);
+  for (const auto& var: m_variables) {
+    double value = m_raw_inputs.at(var.name);
+    if (!std::isfinite(value)) value = var.default_value;
+    m_input_buffer.push_back((value + var.offset) * var.scale);
+  }
+
+  // Jets that don't match any class get all zeros, as in
+  // `make_targets`.
+  for (int class_label: m_labels) {
+    m_target_buffer.push_back(label == class_label ? 1 : 0);
+  }
+
+  // Only write full buffers, so that every chunk is written once.
+  if (m_target_buffer.size() == m_buffer_size * m_labels.size()) flush();
+}
+
+void TrainingWriter::flush() {
+  hsize_t n_rows = m_target_buffer.size() / m_labels.size();
+  if (n_rows == 0) return;
+  if (m_shuffle) shuffle(n_rows);
+  append(m_inputs, H5::PredType::NATIVE_FLOAT, m_input_buffer,
+         m_n_written, n_rows);
+  append(m_targets, H5::PredType::NATIVE_INT, m_target_buffer,
+         m_n_written, n_rows);
+  m_n_written += n_rows;
+  m_input_buffer.clear();
+  m_target_buffer.clear();
+}
+
+// Shuffle the rows in the buffers. We make one permutation (with a
+// Fisher-Yates shuffle) and apply it to both the inputs and targets
+// so they stay in sync.
+void TrainingWriter::shuffle(hsize_t n_rows) {
+  std::vector<hsize_t> order(n_rows);
+  std::iota(order.begin(), order.end(), 0);
+  for (hsize_t i = n_rows; i > 1; i--) {
+    std::swap(order[i - 1], order[uniform_index(m_random, i)]);
+  }
+  m_input_buffer = permute(m_input_buffer, order);
+  m_target_buffer = permute(m_target_buffer, order);
+}
@@ -0,0 +1,116 @@
+#ifndef TRAINING_WRITER_H
+#define TRAINING_WRITER_H
+
+//////////////////////////////////////////////////////////////////////
+// TrainingWriter class
+//////////////////////////////////////////////////////////////////////
+//
+// Writes a dataset that's ready to train on: a 2d float array of
+// normalized inputs, one row per jet, and a 2d array of one-hot
+// targets. The transformations are read from the same
+// `variables.json` that `train_nn.py` writes, so the training inputs
+// are built exactly the way the classifier builds them. The names,
+// offsets, scales, and defaults are also saved as attributes on the
+// inputs, so that the training can write them back out.
+//
+// The outputs are written one chunk at a time, so that a training job
+// can read batches of `chunk_size` jets without touching more than
+// one chunk on disk.
+//
+// Training also wants the jets in random order. Rather than shuffling
+// the whole file afterwards, we can buffer a "window" of jets in
+// memory, shuffle it, and write it out. Jets can also be randomly
+// dropped by flavor, i.e. to throw away most of the light jets. Both
+// use a seeded random number generator, so the output is the same
+// each time the dumper runs on the same inputs. The seed for each
+// run is saved in `training/seeds`. We don't use the standard
+// library shuffle or distributions for this, since those can change
+// from one compiler to the next.
+//
+// If the output already has a training dataset with the same
+// variables and classes, new jets are added to the end of it. As
+// with everything else in the output, they only count once the job
+// commits them (see OutputFile.h).
+//
+//////////////////////////////////////////////////////////////////////
+
+// local includes
+#include "Root/BTagInputs.h"
+
+// EDM includes
+#include "AthContainers/AuxElement.h"
+
+// HDF5
+#include "H5Cpp.h"
+
+// C++ includes
+#include <istream>
+#include <string>
+#include <vector>
+#include <map>
+#include <random>
+
+struct TrainingConfig
+{
+  // number of rows in each chunk
+  hsize_t chunk_size = 2048;
+  // number of jets to shuffle at once, zero for no shuffling. This is
+  // rounded up to a whole number of chunks.
+  hsize_t shuffle_window = 0;
+  // seed for shuffling and downsampling
+  unsigned long seed = 0;
+  // fraction of jets to keep, indexed by truth label. Labels which
+  // aren't listed are all kept.
+  std::map<int, double> keep_fraction;
+};
+
+class TrainingWriter
+{
+public:
+  TrainingWriter(H5::Group& output_group, std::istream& variables,
+                 const TrainingConfig& config = TrainingConfig());
+  ~TrainingWriter();
+
+  // we want to disable copying and assignment, it's not trivial to
+  // make this play well with output files
+  TrainingWriter(TrainingWriter&) = delete;
+  TrainingWriter operator=(TrainingWriter&) = delete;
+
+  void write(const xAOD::Jet& jet);
+  void flush();
+
+private:
+  void shuffle(hsize_t n_rows);
+
+  // one entry for each input variable, in the order they're stored
+  struct Variable
+  {
+    std::string name;
+    double offset;
+    double scale;
+    double default_value;
+  };
+  std::vector<Variable> m_variables;
+  // truth label for each output class
+  std::vector<int> m_labels;
+
+  BTagInputs m_btag_inputs;
+  std::map<std::string, double> m_raw_inputs;
+  SG::AuxElement::ConstAccessor<int> m_label;
+
+  // output datasets and buffers
+  H5::DataSet m_inputs;
+  H5::DataSet m_targets;
+  hsize_t m_chunk_size;
+  hsize_t m_buffer_size;
+  hsize_t m_n_written;
+  std::vector<float> m_input_buffer;
+  std::vector<int> m_target_buffer;
+
+  // shuffling and downsampling
+  bool m_shuffle;
+  std::map<int, double> m_keep_fraction;
+  std::mt19937_64 m_random;
+};
+
+#endif
@@ -1,5 +1,9 @@
 // local tools
+#include "Root/FilePrefetcher.h"
 #include "Root/JetClassifier.h"
+#include "Root/TrainingWriter.h"
+#include "Root/FieldStats.h"
+#include "Root/OutputFile.h"
 
 // EDM things
 #include "xAODJet/JetContainer.h"
@@ -12,6 +16,7 @@
 
 // 3rd party includes
 #include "TFile.h"
+#include "TROOT.h"
 #include "H5Cpp.h"
 #include "lwtnn/LightweightGraph.hh"
 #include "lwtnn/NanReplacer.hh"
@@ -30,7 +35,12 @@
 struct Options
 {
   std::vector<std::string> files;
+  bool prefetch = true;
+  std::string output_file = "output.h5";
+  bool append = false;
   std::string nn_file;
+  std::string training_variables;
+  TrainingConfig training_config;
   std::string jet_collection;
 };
 // simple options parser
@@ -44,13 +54,15 @@ Options get_options(int argc, char *argv[]);
 // (in this case a Jet). Each consumer returns some primative type
 // which is written to the output file.
 //
-// See the function definition below.
+// See the function definition below. The consumers also fill some
+// statistics for each variable, which are saved at the end of the
+// job.
 //
-H5Utils::Consumers<const xAOD::Jet&> getConsumers();
+H5Utils::Consumers<const xAOD::Jet&> getConsumers(OutputStats&);
 //
 // This function adds the nn outputs to the consumer (if we decide to
 // run the NN we just trained).
-void addNN(H5Utils::Consumers<const xAOD::Jet&>&);
+void addNN(H5Utils::Consumers<const xAOD::Jet&>&, OutputStats&);
 
 //////////////////
 // main routine //
@@ -60,8 +72,12 @@ int main (int argc, char *argv[])
   const char* ALG = argv[0];
   Options opts = get_options(argc, argv);
 
+  // The input files are opened on a background thread, so ROOT needs
+  // to know we're using threads before we do anything else with it.
+  if (opts.prefetch) ROOT::EnableThreadSafety();
+
   // maybe apply the NN we're training to this data?
-  std::unique_ptr<const JetClassifier> classifier(nullptr);
+  std::unique_ptr<JetClassifier> classifier(nullptr);
   if (opts.nn_file.size() > 0) {
     std::ifstream input(opts.nn_file.c_str());
     classifier.reset(new JetClassifier(input));
@@ -71,15 +87,25 @@ int main (int argc, char *argv[])
   RETURN_CHECK(ALG, xAOD::Init());
   xAOD::TEvent event(xAOD::TEvent::kClassAccess);
 
-  // set up output file
-  H5::H5File output("output.h5", H5F_ACC_TRUNC);
+  // Set up output file. If we're appending to an existing file we
+  // skip any inputs that are already in it. Anything that was written
+  // by a job that didn't finish is removed when the file is opened.
+  std::vector<std::string> files = uniqueInputs(opts.files);
+  H5::H5File output = openOutput(opts.output_file, opts.append);
+  if (opts.append) {
+    size_t n_inputs = files.size();
+    files = removeProcessed(files, readProvenance(output));
+    std::cout << "skipping " << n_inputs - files.size()
+              << " files that are already in the output" << std::endl;
+  }
 
   // Set up the consumer functions
-  H5Utils::Consumers<const xAOD::Jet&> consumers = getConsumers();
+  OutputStats stats;
+  H5Utils::Consumers<const xAOD::Jet&> consumers = getConsumers(stats);
 
   // If the user passed in an nn, we'll want to add those outputs as
   // well.
-  if (opts.nn_file.size() > 0) addNN(consumers);
+  if (opts.nn_file.size() > 0) addNN(consumers, stats);
 
   // The first argument for the template is the rank of the output. We
   // could be writing out multi-dimensional arrays here, but for this
@@ -92,13 +118,34 @@ int main (int argc, char *argv[])
   //
   // See the "advanced" examples for something more complicated.
   //
-  H5Utils::Writer<0,const xAOD::Jet&> jet_writer(output, "jets", consumers);
+  // The writer can only create new datasets, so we write to a staging
+  // file and append the jets to the output at the end of the job.
+  //
+  StagingFile staging(opts.output_file);
+  H5Utils::Writer<0,const xAOD::Jet&> jet_writer(
+    staging.group(), "jets", consumers);
+  staging.check(output);
+
+  // Optionally write out a dataset that's ready to train on. This
+  // applies the same preprocessing that `train_nn.py` does, so the
+  // training doesn't have to. This one can append to an existing
+  // training dataset directly.
+  std::unique_ptr<TrainingWriter> training_writer(nullptr);
+  if (opts.training_variables.size() > 0) {
+    std::ifstream variables(opts.training_variables.c_str());
+    training_writer.reset(
+      new TrainingWriter(output, variables, opts.training_config));
+  }
+
+  // The next file is opened in the background while we process the
+  // current one.
+  FilePrefetcher prefetcher(files, opts.prefetch);
 
   // Loop over the specified files:
-  for (std::string file_name: opts.files) {
+  for (std::string file_name: files) {
 
     // Open the file:
-    std::unique_ptr<TFile> ifile(TFile::Open(file_name.c_str(), "READ"));
+    std::unique_ptr<TFile> ifile = prefetcher.open(file_name);
     if ( ! ifile.get() || ifile->IsZombie()) {
       throw std::logic_error("Couldn't open file: " + file_name);
       return 1;
@@ -129,12 +176,32 @@ int main (int argc, char *argv[])
         if (jet->pt() > 20e3 && std::abs(jet->eta()) < 2.5) {
           if (classifier) classifier->decorate(*jet);
           jet_writer.fill(*jet);
+          if (training_writer) training_writer->write(*jet);
         }
       }
 
     } // end event loop
   } // end file loop
 
+  prefetcher.printSummary(std::cout);
+
+  // copy the new jets into place
+  jet_writer.flush();
+  if (training_writer) training_writer->flush();
+  staging.appendTo(output);
+
+  // Record the files we've added. Until this point none of the new
+  // jets count, so if the job dies they'll be removed next time.
+  commitOutput(output, files);
+
+  // Save the statistics for each variable. These are combined with
+  // the statistics from earlier jobs. We only do this once the jets
+  // are committed, so the statistics never count jets that might be
+  // removed. If the job dies before this the statistics will be
+  // missing some jets, and they'll be marked as partial next time.
+  hsize_t n_jets = 0;
+  output.openDataSet("jets").getSpace().getSimpleExtentDims(&n_jets);
+  stats.write(output, n_jets);
 
   return 0;
 }
@@ -145,18 +212,49 @@ int main (int argc, char *argv[])
 //
 void usage(std::string name) {
   std::cout << "usage: " << name << " [-h]"
+    " [--no-prefetch]"
+    " [-o OUTPUT]"
+    " [--append]"
     " [--nn-file NN_FILE]"
+    " [--training-variables VARIABLES_JSON]"
+    " [--shuffle-window N_JETS]"
+    " [--seed SEED]"
+    " [--keep-fraction LABEL FRACTION]..."
     " [-c JET_COLLECTION]"
     " <AOD>..." << std::endl;
 }
 Options get_options(int argc, char *argv[]) {
   Options opts;
   opts.jet_collection = "AntiKtVR30Rmax4Rmin02TrackJets";
+  // these only change the training dataset, remember if we see one
+  std::string training_option;
   for (int argn = 1; argn < argc; argn++) {
     std::string arg(argv[argn]);
-    if (arg == "--nn-file") {
+    if (arg == "--no-prefetch") {
+      opts.prefetch = false;
+    } else if (arg == "-o") {
+      argn++;
+      opts.output_file = argv[argn];
+    } else if (arg == "--append") {
+      opts.append = true;
+    } else if (arg == "--nn-file") {
       argn++;
       opts.nn_file = argv[argn];
+    } else if (arg == "--training-variables") {
+      argn++;
+      opts.training_variables = argv[argn];
+    } else if (arg == "--shuffle-window") {
+      training_option = arg;
+      argn++;
+      opts.training_config.shuffle_window = std::stoul(argv[argn]);
+    } else if (arg == "--seed") {
+      training_option = arg;
+      argn++;
+      opts.training_config.seed = std::stoul(argv[argn]);
+    } else if (arg == "--keep-fraction") {
+      training_option = arg;
+      int label = std::stoi(argv[++argn]);
+      opts.training_config.keep_fraction[label] = std::stod(argv[++argn]);
     } else if (arg == "-c") {
       argn++;
       opts.jet_collection = argv[argn];
@@ -171,6 +269,12 @@ Options get_options(int argc, char *argv[]) {
     usage(argv[0]);
     exit(1);
   }
+  if (!training_option.empty() && opts.training_variables.empty()) {
+    std::cerr << training_option << " needs --training-variables"
+              << std::endl;
+    usage(argv[0]);
+    exit(1);
+  }
   return opts;
 }
 
@@ -183,7 +287,7 @@ Options get_options(int argc, char *argv[]) {
 // responsible for copying variables out of EDM objects and into the
 // output file.
 //
-H5Utils::Consumers<const xAOD::Jet&> getConsumers() {
+H5Utils::Consumers<const xAOD::Jet&> getConsumers(OutputStats& stats) {
   using xAOD::Jet;
   typedef SG::AuxElement AE;
 
@@ -198,38 +302,37 @@ H5Utils::Consumers<const xAOD::Jet&> getConsumers() {
   // Each consumer has a return type (here "float"), a name for the
   // output variable ("rnnip_log_ratio"), and a function which returns
   // the desired type.
+  //
+  // We wrap the function so that it also fills the statistics for
+  // this variable. The wrapper converts to the output type first, so
+  // the statistics match what's in the file. The last two arguments
+  // are the histogram range, which we take from `make_hists.py`.
+  auto rnnip = [rnn_pu, rnn_pb](const Jet& j) {
+                 const xAOD::BTagging* btag = j.btagging();
+                 double num = rnn_pb(*btag);
+                 double denom = rnn_pu(*btag);
+                 return std::log(num / denom);
+               };
   consumers.add<float>("rnnip_log_ratio",
-                       [rnn_pu, rnn_pb](const Jet& j) {
-                         const xAOD::BTagging* btag = j.btagging();
-                         double num = rnn_pb(*btag);
-                         double denom = rnn_pu(*btag);
-                         return std::log(num / denom);
-                       });
+                       stats.wrap<float>("rnnip_log_ratio", rnnip, -10, 15));
   AE::ConstAccessor<float> jf_sig("JetFitter_significance3d");
-  consumers.add<float>("jf_sig",
-                       [jf_sig](const Jet& j) {
-                         return jf_sig(*j.btagging());
-                       });
+  auto jf = [jf_sig](const Jet& j) { return jf_sig(*j.btagging()); };
+  consumers.add<float>("jf_sig", stats.wrap<float>("jf_sig", jf, 0, 40));
   std::string label_name = "HadronConeExclExtendedTruthLabelID";
   AE::ConstAccessor<int> label(label_name);
   consumers.add<int>(label_name, [label](const Jet& j) { return label(j); });
   return consumers;
 }
 
-void addNN(H5Utils::Consumers<const xAOD::Jet&>& consumers) {
+void addNN(H5Utils::Consumers<const xAOD::Jet&>& consumers,
+           OutputStats& stats) {
   using xAOD::Jet;
   typedef SG::AuxElement AE;
 
-  AE::ConstAccessor<float> light("nn_light");
-  consumers.add<float>("nn_light", [light](const Jet& j){
-                                   return light(*j.btagging());
-                                 });
-  AE::ConstAccessor<float> charm("nn_charm");
-  consumers.add<float>("nn_charm", [charm](const Jet& j){
-                                   return charm(*j.btagging());
-                                 });
-  AE::ConstAccessor<float> bottom("nn_bottom");
-  consumers.add<float>("nn_bottom", [bottom](const Jet& j){
-                                    return bottom(*j.btagging());
-                                  });
+  // the outputs are probabilities, so the histograms go from 0 to 1
+  for (std::string name: {"nn_light", "nn_charm", "nn_bottom"}) {
+    AE::ConstAccessor<float> output(name);
+    auto func = [output](const Jet& j){ return output(*j.btagging()); };
+    consumers.add<float>(name, stats.wrap<float>(name, func, 0, 1));
+  }
 }
@@ -0,0 +1,54 @@
+#!/usr/bin/env python3
+
+"""
+Print the statistics that the dumper saves for each variable
+"""
+
+import argparse
+import numpy as np
+import h5py
+
+def get_args():
+    parser = argparse.ArgumentParser(description=__doc__)
+    parser.add_argument('input_file')
+    return parser.parse_args()
+
+def run():
+    args = get_args()
+
+    # Unlike the other scripts we don't read any jets here: the dumper
+    # already calculated everything while it was writing them. This
+    # means it's fast even for very large files.
+    with h5py.File(args.input_file, 'r') as infile:
+        stats = infile['stats']
+        n_jets = infile['jets'].shape[0]
+        for varname, group in stats.items():
+            attrs = group.attrs
+            print('{}: {} entries, {} NaN, {} inf'.format(
+                varname, attrs['count'], attrs['nan_count'],
+                attrs['inf_count']))
+
+            # If the dumper appended to a file that didn't have
+            # statistics for this variable, or if a job died before it
+            # saved them, they only cover some jets
+            if attrs.get('partial', 0) or attrs['count'] != n_jets:
+                print('  WARNING: these only cover some of the jets')
+            print('  mean {:.3g}, std {:.3g}, range [{:.3g}, {:.3g}]'.format(
+                attrs['mean'], np.sqrt(attrs['variance']),
+                attrs['min'], attrs['max']))
+
+            # The histogram has one row per flavor, plus one for
+            # everything else. The first and last bins are underflow
+            # and overflow.
+            hist = np.asarray(group['hist'])
+            flavors = list(group['hist'].attrs['flavors']) + ['other']
+            for flavor, row in zip(flavors, hist):
+                total = row.sum()
+                if total == 0:
+                    continue
+                print('  flavor {}: {} jets, {:.1%} underflow, '
+                      '{:.1%} overflow'.format(
+                          flavor, total, row[0] / total, row[-1] / total))
+
+if __name__ == '__main__':
+    run()
@@ -28,19 +28,31 @@ def get_args():
 def run():
     args = get_args()
 
-    # get the jets out of the input file.
+    # get the jets out of the input file. If the dumper already wrote
+    # out a preprocessed training dataset we can use it directly,
+    # otherwise we have to make the training dataset here.
+    #
+    # The training dataset might have been made with a different
+    # variables.json than the one we'd write, so we write out the one
+    # it was made with instead.
     with h5py.File(args.input_file, 'r') as infile:
-        jets = np.asarray(infile['jets'])
-
-    # first, let's make the training dataset!
-    input_data = preproc_inputs(jets)
-    targets = make_targets(jets)
+        variables_json = None
+        if 'training' in infile:
+            variables_json = get_training_variables(infile['training'])
+        if variables_json:
+            input_data = np.asarray(infile['training/inputs'])
+            targets = np.asarray(infile['training/targets'])
+        else:
+            variables_json = get_variables_json()
+            jets = np.asarray(infile['jets'])
+            input_data = preproc_inputs(jets)
+            targets = make_targets(jets)
 
     # now make the network
     from keras.layers import Input, Dense, Softmax
     from keras.models import Model
 
-    input_node = Input(shape=(2,))
+    input_node = Input(shape=(input_data.shape[1],))
     dense = Dense(3)(input_node)
     pred = Softmax()(dense)
     model = Model(inputs=input_node, outputs=pred)
@@ -61,7 +73,7 @@ def run():
 
     # also write out the variable specification
     with open(f'{odir}/variables.json', 'w') as vars_file:
-        json.dump(get_variables_json(), vars_file)
+        json.dump(variables_json, vars_file)
 
 
 def make_targets(jets):
@@ -107,6 +119,7 @@ JF_SCALE = 0.75
 RNN_OFFSET = 3.0
 RNN_SCALE = 0.25
 RNN_DEFAULT = -9
+JF_DEFAULT = 0
 
 def preproc_inputs(jets):
     """
@@ -115,17 +128,52 @@ def preproc_inputs(jets):
 
     # The jf_sig variable has a long tail. To "normalize" this a bit
     # we take the log(x + 1) transformation.
-    jf = (np.log1p(jets['jf_sig']) + JF_OFFSET ) * JF_SCALE
+    jf = np.log1p(jets['jf_sig'])
+    jf[~np.isfinite(jf)] = JF_DEFAULT
+    jf = (jf + JF_OFFSET) * JF_SCALE
 
     # the rnnip ratio has the weird feature that the outputs are
-    # sometimes NAN (because the algorithm returns zeros for all
-    # classes when no tracks are found). We have to replace these nan
-    # values with some other default
+    # sometimes NAN or infinite (because the algorithm returns zeros
+    # for all classes when no tracks are found). We have to replace
+    # these values with some other default, the same way lwtnn does.
     rnnip = jets['rnnip_log_ratio']
-    rnnip[np.isnan(rnnip)] = RNN_DEFAULT
+    rnnip[~np.isfinite(rnnip)] = RNN_DEFAULT
     rnnip = (rnnip + RNN_OFFSET) * RNN_SCALE
     return np.stack([jf, rnnip], axis=1)
 
+def get_training_variables(training):
+    """
+    Get the variable specification that the dumper used to make the
+    training dataset. Returns None if we can't use the dataset.
+    """
+    def as_str(name):
+        return name.decode() if isinstance(name, bytes) else str(name)
+
+    inputs = training['inputs'].attrs
+    keys = ['variables', 'offsets', 'scales', 'defaults']
+    if not all(key in inputs for key in keys):
+        print('training dataset has no transformations, rebuilding it')
+        return None
+
+    # the rest of this script expects these classes, in this order
+    variables_json = get_variables_json()
+    classes = [as_str(x) for x in training['targets'].attrs['classes']]
+    if classes != variables_json['outputs'][0]['labels']:
+        print(f'unexpected classes {classes} in training dataset, '
+              'rebuilding it')
+        return None
+
+    btag_variables = []
+    for name, offset, scale, default in zip(*(inputs[k] for k in keys)):
+        btag_variables.append({
+            'name': as_str(name),
+            'offset': float(offset),
+            'scale': float(scale),
+            'default': float(default),
+        })
+    variables_json['inputs'][0]['variables'] = btag_variables
+    return variables_json
+
 def get_variables_json():
     """
     Make a file that specifies the input variables and
@@ -144,6 +192,7 @@ def get_variables_json():
             'name': 'jf_sig_log1p',
             'offset': JF_OFFSET,
             'scale': JF_SCALE,
+            'default': JF_DEFAULT,
         },
         {
             'name': 'rnnip_log_ratio',
@@ -0,0 +1,190 @@
+#ifndef APPENDABLE_H
+#define APPENDABLE_H
+
+//////////////////////////////////////////////////////////////////////
+// Checks and bookkeeping for datasets that we append to
+//////////////////////////////////////////////////////////////////////
+//
+// Any dataset that can grow over several jobs is "marked" with an
+// `appendable` attribute. The file keeps one record of how many rows
+// of each marked dataset were written by jobs that finished: this is
+// the `committed_rows` attribute on the root group, a string with one
+// "<rows> <dataset path>" line per dataset.
+//
+// Since it's a single attribute, everything is committed at once
+// (see `commitOutput` in OutputFile.h). If a job dies partway
+// through, the rows it wrote are past the counts in the record, and
+// they are removed the next time the file is opened to append.
+// Marked datasets that aren't in the record at all were created by a
+// job that never finished, so none of their rows count.
+//
+// These are all inline, so that header-only writers can use them
+// without linking anything else.
+//
+//////////////////////////////////////////////////////////////////////
+
+// HDF5
+#include "H5Cpp.h"
+
+// C++ includes
+#include <algorithm>
+#include <map>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+// name of the attribute that marks a dataset we append to
+static const std::string APPENDABLE = "appendable";
+// name of the attribute on the root group that records the committed
+// rows
+static const std::string COMMITTED_ROWS = "committed_rows";
+
+// committed rows, indexed by the full path to the dataset
+typedef std::map<std::string, unsigned long long> RowCounts;
+
+// true if there's a link with this name in the group
+inline bool exists(const H5::Group& group, const std::string& name) {
+  return H5Lexists(group.getId(), name.c_str(), H5P_DEFAULT) > 0;
+}
+
+inline std::vector<hsize_t> datasetDims(const H5::DataSet& ds) {
+  H5::DataSpace space = ds.getSpace();
+  std::vector<hsize_t> dims(space.getSimpleExtentNdims());
+  space.getSimpleExtentDims(dims.data());
+  return dims;
+}
+
+// Compare the chunking and filters (i.e. compression) of two sets of
+// creation properties.
+inline bool sameCreateProps(const H5::DSetCreatPropList& p1,
+                            const H5::DSetCreatPropList& p2) {
+  if (p1.getLayout() != p2.getLayout()) return false;
+  if (p1.getLayout() == H5D_CHUNKED) {
+    int rank = p1.getChunk(0, nullptr);
+    if (rank != p2.getChunk(0, nullptr)) return false;
+    std::vector<hsize_t> c1(rank), c2(rank);
+    p1.getChunk(rank, c1.data());
+    p2.getChunk(rank, c2.data());
+    if (c1 != c2) return false;
+  }
+  int n_filters = p1.getNfilters();
+  if (n_filters != p2.getNfilters()) return false;
+  for (int i = 0; i < n_filters; i++) {
+    unsigned int flags, config;
+    char name[64];
+    std::vector<unsigned int> v1(8), v2(8);
+    size_t n1 = v1.size(), n2 = v2.size();
+    H5Z_filter_t f1 = p1.getFilter(i, flags, n1, v1.data(),
+                                   sizeof(name), name, config);
+    H5Z_filter_t f2 = p2.getFilter(i, flags, n2, v2.data(),
+                                   sizeof(name), name, config);
+    v1.resize(std::min(n1, v1.size()));
+    v2.resize(std::min(n2, v2.size()));
+    if (f1 != f2 || v1 != v2) return false;
+  }
+  return true;
+}
+
+// Check that something with this type, creation properties (chunking
+// and compression) and row shape can be appended to `existing`.
+// Throws std::logic_error if not.
+inline void checkAppendable(const H5::DataSet& existing,
+                            const H5::DataType& type,
+                            const H5::DSetCreatPropList& props,
+                            const std::vector<hsize_t>& row_dims) {
+  std::string name = existing.getObjName();
+  if (!(existing.getDataType() == type)) {
+    throw std::logic_error("can't append to " + name + ": types differ");
+  }
+  std::vector<hsize_t> dims = datasetDims(existing);
+  if (std::vector<hsize_t>(dims.begin() + 1, dims.end()) != row_dims) {
+    throw std::logic_error("can't append to " + name + ": shapes differ");
+  }
+  if (!sameCreateProps(existing.getCreatePlist(), props)) {
+    throw std::logic_error(
+      "can't append to " + name + ": chunking or compression differ");
+  }
+}
+// Same as above, comparing to another dataset.
+inline void checkAppendable(const H5::DataSet& existing,
+                            const H5::DataSet& other) {
+  std::vector<hsize_t> dims = datasetDims(other);
+  checkAppendable(existing, other.getDataType(), other.getCreatePlist(),
+                  std::vector<hsize_t>(dims.begin() + 1, dims.end()));
+}
+
+// The root group of the file that `obj` is in.
+inline H5::Group rootGroup(const H5::H5Location& obj) {
+  hid_t id = H5Gopen(obj.getId(), "/", H5P_DEFAULT);
+  if (id < 0) throw std::runtime_error("can't open the root group");
+  // the Group takes its own reference, so we close this one
+  H5::Group root(id);
+  H5Gclose(id);
+  return root;
+}
+
+// Read and write the record of committed rows. Writing replaces the
+// whole record in one go.
+inline RowCounts readCommitted(const H5::Group& root) {
+  RowCounts counts;
+  if (!root.attrExists(COMMITTED_ROWS)) return counts;
+  H5::Attribute attr = root.openAttribute(COMMITTED_ROWS);
+  H5::StrType type(H5::PredType::C_S1, H5T_VARIABLE);
+  char* c_record = nullptr;
+  attr.read(type, &c_record);
+  // this is null if the attribute was created but never written
+  std::string record(c_record ? c_record : "");
+  H5::DataSpace space = attr.getSpace();
+  H5::DataSet::vlenReclaim(&c_record, type, space);
+  std::istringstream lines(record);
+  unsigned long long rows;
+  std::string path;
+  while (lines >> rows >> path) counts[path] = rows;
+  return counts;
+}
+inline void writeCommitted(H5::Group& root, const RowCounts& counts) {
+  std::ostringstream record;
+  for (const auto& count: counts) {
+    record << count.second << " " << count.first << "\n";
+  }
+  std::string text = record.str();
+  const char* c_record = text.c_str();
+  H5::StrType type(H5::PredType::C_S1, H5T_VARIABLE);
+  if (!root.attrExists(COMMITTED_ROWS)) {
+    H5::DataSpace scalar;
+    root.createAttribute(COMMITTED_ROWS, type, scalar);
+  }
+  root.openAttribute(COMMITTED_ROWS).write(type, &c_record);
+}
+
+inline bool isAppendable(const H5::DataSet& ds) {
+  return ds.attrExists(APPENDABLE);
+}
+
+// Mark a dataset that we append to, with none of its rows committed.
+inline void markUncommitted(H5::DataSet& ds) {
+  if (!isAppendable(ds)) {
+    H5::DataSpace scalar;
+    int flag = 1;
+    ds.createAttribute(APPENDABLE, H5::PredType::NATIVE_INT, scalar)
+      .write(H5::PredType::NATIVE_INT, &flag);
+  }
+  H5::Group root = rootGroup(ds);
+  RowCounts counts = readCommitted(root);
+  if (counts.erase(ds.getObjName())) writeCommitted(root, counts);
+}
+
+// Mark a dataset that we append to. This should be called when the
+// dataset is created or opened. If it wasn't marked before, all the
+// rows that are there now count as committed.
+inline void markAppendable(H5::DataSet& ds) {
+  if (isAppendable(ds)) return;
+  markUncommitted(ds);
+  H5::Group root = rootGroup(ds);
+  RowCounts counts = readCommitted(root);
+  counts[ds.getObjName()] = datasetDims(ds).at(0);
+  writeCommitted(root, counts);
+}
+
+#endif
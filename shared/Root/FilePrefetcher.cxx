@@ -0,0 +1,104 @@
+#include "Root/FilePrefetcher.h"
+
+// ROOT
+#include "TFile.h"
+#include "TTree.h"
+
+// C++ includes
+#include <algorithm>
+#include <chrono>
+#include <iomanip>
+
+namespace {
+
+  typedef std::chrono::steady_clock Clock;
+  double seconds_since(Clock::time_point start) {
+    return std::chrono::duration<double>(Clock::now() - start).count();
+  }
+
+  // This is what runs in the background: open the file, then read
+  // the trees that TEvent will ask for. The file keeps the trees
+  // once they are read, so TEvent gets these same objects.
+  FilePrefetcher::OpenedFile open_file(const std::string& name) {
+    FilePrefetcher::OpenedFile opened;
+    auto start = Clock::now();
+    opened.file.reset(TFile::Open(name.c_str(), "READ"));
+    opened.open_seconds = seconds_since(start);
+    opened.header_seconds = 0;
+    if (!opened.file || opened.file->IsZombie()) return opened;
+
+    start = Clock::now();
+    for (const char* tree_name: {"CollectionTree", "MetaData"}) {
+      TTree* tree = nullptr;
+      opened.file->GetObject(tree_name, tree);
+    }
+    opened.header_seconds = seconds_since(start);
+    return opened;
+  }
+}
+
+FilePrefetcher::FilePrefetcher(const std::vector<std::string>& files,
+                               bool prefetch):
+  m_files(files),
+  m_prefetch(prefetch),
+  m_next(0)
+{
+}
+
+FilePrefetcher::~FilePrefetcher() {
+  // don't leave the background thread running
+  if (m_pending.valid()) m_pending.wait();
+}
+
+std::unique_ptr<TFile> FilePrefetcher::open(const std::string& name) {
+  auto start = Clock::now();
+
+  // Figure out where we are in the list. Usually this is just the
+  // next file, but if someone skipped ahead we look for it. We go by
+  // position rather than name, since the same file might be in the
+  // list twice.
+  bool in_order = m_next < m_files.size() && m_files.at(m_next) == name;
+  if (!in_order) {
+    auto pos = std::find(m_files.begin() + std::min(m_next, m_files.size()),
+                         m_files.end(), name);
+    m_next = pos - m_files.begin();
+  }
+  bool prefetched = in_order && m_pending.valid();
+  OpenedFile opened = prefetched ? m_pending.get() : open_file(name);
+  m_summary.push_back({name, opened.open_seconds, opened.header_seconds,
+        seconds_since(start), prefetched});
+
+  // Start on the next file. If we didn't use the one we prefetched it
+  // gets closed here.
+  if (m_pending.valid()) m_pending.wait();
+  m_pending = std::future<OpenedFile>();
+  if (m_next < m_files.size()) m_next++;
+  if (m_prefetch && m_next < m_files.size()) {
+    m_pending = std::async(std::launch::async, open_file, m_files.at(m_next));
+  }
+  return std::move(opened.file);
+}
+
+void FilePrefetcher::printSummary(std::ostream& out) const {
+  // we change the formatting below, save it so we can put it back
+  std::ios::fmtflags flags(out.flags());
+  std::streamsize precision = out.precision();
+  out << "file open summary (seconds):\n";
+  out << std::setw(10) << "open" << std::setw(10) << "headers"
+      << std::setw(10) << "waited" << "  file\n";
+  double total_open = 0;
+  double total_wait = 0;
+  for (const auto& file: m_summary) {
+    out << std::fixed << std::setprecision(3)
+        << std::setw(10) << file.open_seconds
+        << std::setw(10) << file.header_seconds
+        << std::setw(10) << file.wait_seconds << "  " << file.name
+        << (file.prefetched ? "" : " (not prefetched)") << "\n";
+    total_open += file.open_seconds + file.header_seconds;
+    total_wait += file.wait_seconds;
+  }
+  out << "total: " << total_open << " s opening, "
+      << total_wait << " s waiting" << std::endl;
+  out.flags(flags);
+  out.precision(precision);
+}
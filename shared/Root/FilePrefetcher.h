@@ -0,0 +1,84 @@
+#ifndef FILE_PREFETCHER_H
+#define FILE_PREFETCHER_H
+
+//////////////////////////////////////////////////////////////////////
+// FilePrefetcher class
+//////////////////////////////////////////////////////////////////////
+//
+// Opens input files on a background thread. When file i is opened,
+// we start opening file i+1 right away, so that by the time we're
+// done with file i the next one is (hopefully) ready to go. This
+// helps a lot on the grid or with remote files, where opening a file
+// and reading the metadata can take a while.
+//
+// Along with opening the file we also read the headers of the event
+// and metadata trees. An xAOD has thousands of branches, so this is
+// a big part of the time it takes to get started on a file. We don't
+// touch the tree's read cache though: TEvent picks up these same
+// trees and decides which branches it needs to read.
+//
+// ROOT has to be told that we're using threads, so call
+// `ROOT::EnableThreadSafety()` at the start of `main`, before
+// anything else touches ROOT.
+//
+// Every open is timed, and `printSummary` will show how long each
+// file took to open and how long we actually had to wait for it.
+//
+//////////////////////////////////////////////////////////////////////
+
+// C++ includes
+#include <future>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <vector>
+
+class TFile;
+
+class FilePrefetcher
+{
+public:
+  // If `prefetch` is false everything is opened on the main thread,
+  // which is useful to compare timing.
+  FilePrefetcher(const std::vector<std::string>& files,
+                 bool prefetch = true);
+  ~FilePrefetcher();
+
+  FilePrefetcher(FilePrefetcher&) = delete;
+  FilePrefetcher operator=(FilePrefetcher&) = delete;
+
+  // Get a file. Files should be asked for in the order they were
+  // given to the constructor. If this file was prefetched we wait for
+  // it, otherwise we open it here. Either way we start prefetching
+  // the next file in the list. As with TFile::Open, you should check
+  // that the result isn't null or a zombie.
+  std::unique_ptr<TFile> open(const std::string& file_name);
+
+  void printSummary(std::ostream&) const;
+
+  // this is what we get back from the background thread
+  struct OpenedFile
+  {
+    std::unique_ptr<TFile> file;
+    double open_seconds;
+    double header_seconds;
+  };
+
+private:
+  struct FileSummary
+  {
+    std::string name;
+    double open_seconds;
+    double header_seconds;
+    double wait_seconds;
+    bool prefetched;
+  };
+  std::vector<std::string> m_files;
+  bool m_prefetch;
+  // position in `m_files` of the next file we expect to open
+  size_t m_next;
+  std::future<OpenedFile> m_pending;
+  std::vector<FileSummary> m_summary;
+};
+
+#endif
@@ -0,0 +1,233 @@
+#include "Root/OutputFile.h"
+
+// C++ includes
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <map>
+
+namespace {
+
+  const std::string PROVENANCE = "provenance";
+
+  std::string base_name(const std::string& path) {
+    return path.substr(path.find_last_of('/') + 1);
+  }
+
+  // find every marked dataset in a group and its subgroups
+  void find_marked(H5::Group& group, std::vector<H5::DataSet>& found) {
+    for (hsize_t i = 0; i < group.getNumObjs(); i++) {
+      std::string name = group.getObjnameByIdx(i);
+      H5O_type_t type = group.childObjType(name);
+      if (type == H5O_TYPE_GROUP) {
+        H5::Group subgroup = group.openGroup(name);
+        find_marked(subgroup, found);
+      } else if (type == H5O_TYPE_DATASET) {
+        H5::DataSet ds = group.openDataSet(name);
+        if (isAppendable(ds)) found.push_back(ds);
+      }
+    }
+  }
+
+  // remove any rows that weren't committed
+  void roll_back(H5::DataSet& ds, const RowCounts& counts) {
+    std::vector<hsize_t> dims = datasetDims(ds);
+    auto count = counts.find(ds.getObjName());
+    hsize_t committed = count == counts.end() ? 0 : count->second;
+    if (dims.at(0) <= committed) return;
+    std::cout << "removing " << dims.at(0) - committed << " rows from "
+              << ds.getObjName() << " that were never committed"
+              << std::endl;
+    dims.at(0) = committed;
+    if (H5Dset_extent(ds.getId(), dims.data()) < 0) {
+      throw std::runtime_error("can't shrink " + ds.getObjName());
+    }
+  }
+
+  // Copy `n_rows` rows from `source`, starting at `first`, to
+  // `target`, starting at `offset`. The buffer has to be big enough.
+  void copy_rows(const H5::DataSet& source, hsize_t first,
+                 H5::DataSet& target, hsize_t offset,
+                 hsize_t n_rows, std::vector<char>& buffer) {
+    std::vector<hsize_t> count = datasetDims(source);
+    count.at(0) = n_rows;
+    H5::DataSpace mem_space(count.size(), count.data());
+    std::vector<hsize_t> start(count.size(), 0);
+
+    H5::DataSpace src_space = source.getSpace();
+    start.at(0) = first;
+    src_space.selectHyperslab(H5S_SELECT_SET, count.data(), start.data());
+    H5::DataType type = source.getDataType();
+    source.read(buffer.data(), type, mem_space, src_space);
+
+    H5::DataSpace tgt_space = target.getSpace();
+    start.at(0) = offset;
+    tgt_space.selectHyperslab(H5S_SELECT_SET, count.data(), start.data());
+    target.write(buffer.data(), type, mem_space, tgt_space);
+  }
+}
+
+H5::H5File openOutput(const std::string& file_name, bool append) {
+  if (!append || !std::ifstream(file_name).good()) {
+    return H5::H5File(file_name, H5F_ACC_TRUNC);
+  }
+  H5::H5File file(file_name, H5F_ACC_RDWR);
+  RowCounts counts = readCommitted(file);
+  std::vector<H5::DataSet> marked;
+  find_marked(file, marked);
+  for (auto& ds: marked) roll_back(ds, counts);
+  return file;
+}
+
+std::set<std::string> readProvenance(const H5::Group& output) {
+  std::set<std::string> files;
+  if (!exists(output, PROVENANCE)) return files;
+  H5::DataSet ds = output.openDataSet(PROVENANCE);
+  std::vector<char*> names(datasetDims(ds).at(0));
+  H5::StrType type(H5::PredType::C_S1, H5T_VARIABLE);
+  ds.read(names.data(), type);
+  for (char* name: names) files.insert(name);
+  H5::DataSpace space = ds.getSpace();
+  H5::DataSet::vlenReclaim(names.data(), type, space);
+  return files;
+}
+
+std::vector<std::string> uniqueInputs(const std::vector<std::string>& files) {
+  // the full path for each name we've seen
+  std::map<std::string, std::string> seen;
+  std::vector<std::string> unique;
+  for (const auto& file: files) {
+    auto added = seen.emplace(base_name(file), file);
+    if (added.second) {
+      unique.push_back(file);
+    } else if (added.first->second == file) {
+      std::cout << "skipping " << file << ", it's listed twice" << std::endl;
+    } else {
+      throw std::logic_error(
+        "two input files are named " + added.first->first + ": " +
+        added.first->second + " and " + file);
+    }
+  }
+  return unique;
+}
+
+std::vector<std::string> removeProcessed(
+  const std::vector<std::string>& files, const std::set<std::string>& done) {
+  std::vector<std::string> todo;
+  for (const auto& file: files) {
+    if (!done.count(base_name(file))) todo.push_back(file);
+  }
+  return todo;
+}
+
+void commitOutput(H5::Group& output, const std::vector<std::string>& files) {
+  // add the new files to the provenance
+  H5::StrType type(H5::PredType::C_S1, H5T_VARIABLE);
+  H5::DataSet prov;
+  if (exists(output, PROVENANCE)) {
+    prov = output.openDataSet(PROVENANCE);
+  } else {
+    hsize_t dims[1] = {0};
+    hsize_t max_dims[1] = {H5S_UNLIMITED};
+    H5::DataSpace space(1, dims, max_dims);
+    H5::DSetCreatPropList props;
+    hsize_t chunks[1] = {64};
+    props.setChunk(1, chunks);
+    prov = output.createDataSet(PROVENANCE, type, space, props);
+  }
+  markAppendable(prov);
+  if (!files.empty()) {
+    std::vector<std::string> names;
+    std::vector<const char*> c_names;
+    for (const auto& file: files) names.push_back(base_name(file));
+    for (const auto& name: names) c_names.push_back(name.c_str());
+    hsize_t offset = datasetDims(prov).at(0);
+    hsize_t new_dims[1] = {offset + c_names.size()};
+    prov.extend(new_dims);
+    H5::DataSpace file_space = prov.getSpace();
+    hsize_t start[1] = {offset};
+    hsize_t count[1] = {c_names.size()};
+    file_space.selectHyperslab(H5S_SELECT_SET, count, start);
+    H5::DataSpace mem_space(1, count);
+    prov.write(c_names.data(), type, mem_space, file_space);
+  }
+
+  // Commit the rows in every dataset, including the provenance. This
+  // is a single write, so the datasets and the provenance are always
+  // committed together.
+  RowCounts counts;
+  std::vector<H5::DataSet> marked;
+  find_marked(output, marked);
+  for (const auto& ds: marked) {
+    counts[ds.getObjName()] = datasetDims(ds).at(0);
+  }
+  H5::Group root = rootGroup(output);
+  writeCommitted(root, counts);
+  H5Fflush(output.getId(), H5F_SCOPE_GLOBAL);
+}
+
+
+StagingFile::StagingFile(const std::string& output_name):
+  m_name(output_name + ".staging"),
+  m_file(m_name, H5F_ACC_TRUNC)
+{
+}
+
+StagingFile::~StagingFile() {
+  m_file.close();
+  std::remove(m_name.c_str());
+}
+
+H5::Group& StagingFile::group() {
+  return m_file;
+}
+
+void StagingFile::check(H5::Group& output) const {
+  for (hsize_t i = 0; i < m_file.getNumObjs(); i++) {
+    std::string name = m_file.getObjnameByIdx(i);
+    if (!exists(output, name)) continue;
+    checkAppendable(output.openDataSet(name), m_file.openDataSet(name));
+  }
+}
+
+void StagingFile::appendTo(H5::Group& output) const {
+  check(output);
+  for (hsize_t i = 0; i < m_file.getNumObjs(); i++) {
+    std::string name = m_file.getObjnameByIdx(i);
+
+    // If there's nothing to append to we copy the whole dataset. None
+    // of it is committed yet.
+    if (!exists(output, name)) {
+      if (H5Ocopy(m_file.getId(), name.c_str(), output.getId(),
+                  name.c_str(), H5P_DEFAULT, H5P_DEFAULT) < 0) {
+        throw std::runtime_error("can't copy " + name + " to the output");
+      }
+      H5::DataSet copied = output.openDataSet(name);
+      markUncommitted(copied);
+      continue;
+    }
+
+    // Otherwise copy the rows over, a block at a time. Note that this
+    // treats each row as raw bytes, which is fine for the numbers we
+    // write but wouldn't work for variable length types.
+    H5::DataSet source = m_file.openDataSet(name);
+    H5::DataSet target = output.openDataSet(name);
+    markAppendable(target);
+    std::vector<hsize_t> src_dims = datasetDims(source);
+    std::vector<hsize_t> tgt_dims = datasetDims(target);
+    const hsize_t offset = tgt_dims.at(0);
+    tgt_dims.at(0) += src_dims.at(0);
+    target.extend(tgt_dims.data());
+
+    size_t row_size = source.getDataType().getSize();
+    for (size_t dim = 1; dim < src_dims.size(); dim++) {
+      row_size *= src_dims.at(dim);
+    }
+    const hsize_t block = 2048;
+    std::vector<char> buffer(block * row_size);
+    for (hsize_t first = 0; first < src_dims.at(0); first += block) {
+      hsize_t n_rows = std::min(block, src_dims.at(0) - first);
+      copy_rows(source, first, target, offset + first, n_rows, buffer);
+    }
+  }
+}
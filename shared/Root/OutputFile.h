@@ -0,0 +1,94 @@
+#ifndef OUTPUT_FILE_H
+#define OUTPUT_FILE_H
+
+//////////////////////////////////////////////////////////////////////
+// Output file utilities
+//////////////////////////////////////////////////////////////////////
+//
+// Functions to add new jets to an existing output file, rather than
+// starting over each time a few more input files show up.
+//
+// The input files that went into the output are listed in a
+// `provenance` dataset, so that we can skip them the next time
+// around. Files are identified by their name without the directory,
+// since the same file might be read from a different place.
+//
+// Nothing a job writes counts until `commitOutput` is called at the
+// end. This adds the input files to `provenance`, then writes the
+// number of rows in every dataset (including `provenance`) to the
+// record of committed rows in a single write (see Appendable.h). If
+// the job dies before that, nothing it added counts: when we open a
+// file to append, any rows past the committed counts are removed, so
+// those jets aren't added a second time.
+//
+// The H5Utils::Writer can only create new datasets. To append with
+// it, we write to a StagingFile, which is a separate HDF5 file next
+// to the output. At the end of the job the rows are copied over and
+// the staging file is deleted.
+//
+//////////////////////////////////////////////////////////////////////
+
+// local things
+#include "Root/Appendable.h"
+
+// HDF5
+#include "H5Cpp.h"
+
+// C++ includes
+#include <set>
+#include <string>
+#include <vector>
+
+// Open the output file. If `append` is set and the file exists we
+// open it for writing and remove anything that wasn't committed,
+// otherwise we create a new file.
+H5::H5File openOutput(const std::string& file_name, bool append);
+
+// Read the list of input files that are already in the output.
+std::set<std::string> readProvenance(const H5::Group& output);
+
+// Check the list of input files. A file that's listed twice is only
+// read once. Different files with the same name (i.e. in different
+// directories) aren't allowed: the provenance only keeps the names,
+// so we couldn't tell them apart later. Throws std::logic_error.
+std::vector<std::string> uniqueInputs(const std::vector<std::string>& files);
+
+// Remove files that are already in the output from a list of inputs.
+std::vector<std::string> removeProcessed(
+  const std::vector<std::string>& files, const std::set<std::string>& done);
+
+// Record that `files` are in the output, and commit all the rows that
+// have been written. Call this once everything has been written.
+void commitOutput(H5::Group& output, const std::vector<std::string>& files);
+
+
+class StagingFile
+{
+public:
+  // The staging file is named after the output, with `.staging`
+  // added at the end. Any old one is overwritten.
+  StagingFile(const std::string& output_name);
+  // this deletes the file
+  ~StagingFile();
+
+  StagingFile(StagingFile&) = delete;
+  StagingFile operator=(StagingFile&) = delete;
+
+  // the group to give the writers
+  H5::Group& group();
+
+  // Check that each staged dataset can be appended to the one with
+  // the same name in `output`. Call this before we start processing,
+  // so that we fail early.
+  void check(H5::Group& output) const;
+
+  // Append everything to the datasets with the same names in
+  // `output`. Datasets that don't exist yet are copied.
+  void appendTo(H5::Group& output) const;
+
+private:
+  std::string m_name;
+  H5::H5File m_file;
+};
+
+#endif